@@ -1,17 +1,36 @@
-from flask import Flask, request, jsonify
+from flask import Flask, Blueprint, current_app, request, jsonify, render_template, url_for
 from flask_sqlalchemy import SQLAlchemy
+from sqlalchemy import create_engine, delete, extract, func, insert, inspect, literal_column, or_, select, text, union_all
+from sqlalchemy.exc import IntegrityError, OperationalError
+from werkzeug.exceptions import RequestEntityTooLarge
 from datetime import datetime, timedelta
-import pytz
-from dateutil import parser
+from itertools import groupby
+import click
+import hmac
+from flask.cli import with_appcontext
+import json
+import math
+import os
+import random
+import re
+import threading
+import time
+from assets import IMMUTABLE_MAX_AGE, AssetManifest
+from compression import BodyCache, CachedBody, choose_encoding, compress, compressible
+import msgpack
+from rules import RuleBook
+from schemas import BLACKOUT, BOOKING, CHANGE, HOLD, OWNER, RESOURCE, SchemaError
+from schedule_index import SLOT, ScheduleIndex, Timeline
+from timing_wheel import TimingWheel
+from timeutil import (PST, AmbiguousTimeError, NonExistentTimeError, add_elapsed, format_local,
+                      localize, now_pst, now_utc, parse_local, utc_offset, utc_to_epoch, wall_offset, wall_to_epoch)
 
-app = Flask(__name__)
-app.config['SQLALCHEMY_DATABASE_URI'] = 'sqlite:///reservations.db'
-app.config['SQLALCHEMY_TRACK_MODIFICATIONS'] = False
-db = SQLAlchemy(app)
-
-# Define the PST timezone
-PST = pytz.timezone('America/Los_Angeles')
+# Extensions are created unbound and attached to an app in create_app().
+db = SQLAlchemy()
+bp = Blueprint('reservations', __name__)
 
+# Built-in booking rules. RULES_FILE can tighten them per pool or resource
+# (see rules.py) but never exceed them.
 # Maximum reservation duration (e.g., 4 hours)
 MAX_RESERVATION_DURATION = timedelta(hours=4)
 # Minimum time slot (15 minutes)
@@ -19,258 +38,2471 @@ MIN_RESERVATION_DURATION = timedelta(minutes=15)
 # Advance booking limit (30 days)
 ADVANCE_BOOKING_LIMIT = timedelta(days=30)
 
-class Reservation(db.Model):
+DEFAULT_CONFIG = {
+    'SQLALCHEMY_DATABASE_URI': 'sqlite:///reservations.db',
+    'SQLALCHEMY_TRACK_MODIFICATIONS': False,
+    # How long a SQLite connection waits for another writer's lock (BEGIN
+    # IMMEDIATE included) before giving up; a booking that still can't get the
+    # lock is answered with 503 and Retry-After.
+    'SQLITE_BUSY_TIMEOUT_SECONDS': 30,
+    # Create missing tables when the app is built (never on a request path).
+    'BOOTSTRAP_SCHEMA': True,
+    # How often a pool's membership and resource versions are re-read from the
+    # database before pooled allocation (other workers may have written).
+    'SCHEDULE_INDEX_SYNC_SECONDS': 5.0,
+    # Holds (POST /reservations/hold) last this long unless the request asks
+    # for less; unconfirmed holds are released by a timing wheel checked every
+    # HOLD_SWEEP_SECONDS.
+    'HOLD_DEFAULT_SECONDS': 120,
+    'HOLD_MAX_SECONDS': 600,
+    'HOLD_SWEEP_SECONDS': 1.0,
+    # Reservations that ended more than this many days ago move to the archive table.
+    'ARCHIVE_RETENTION_DAYS': 30,
+    # Rows moved per archive transaction; bookings wait for at most one batch.
+    'ARCHIVE_BATCH_SIZE': 500,
+    # Seconds between background archive passes; 0 disables the background job
+    # (run `flask --app app archive` from cron instead).
+    'ARCHIVE_INTERVAL_SECONDS': 3600,
+    # Optional read replica or snapshot copy for GET /analytics; None reads the
+    # main database in one short read transaction.
+    'ANALYTICS_DATABASE_URI': None,
+    # Per-user limits checked on every booking; None disables a limit.
+    'QUOTA_WEEKLY_HOURS': 10,
+    'QUOTA_ACTIVE_RESERVATIONS': 3,
+    # Seconds after midnight during which bookings for the day that just opened
+    # are queued (answered 202 with a status URL) and then allocated together;
+    # 0 books them first come, first served. OPENING_ROUND_POLICY is
+    # 'round_robin' or 'lottery'.
+    'OPENING_ROUND_SECONDS': 0,
+    'OPENING_ROUND_POLICY': 'round_robin',
+    # Most bookings one priority booking may displace; above this it gets a 409.
+    'PREEMPT_MAX_DISPLACED': 3,
+    # Shared secret a priority booking must send in the X-Priority-Token
+    # header. None (the default) turns priority bookings off.
+    'PRIORITY_TOKEN': None,
+    # Optional JSON file of per-pool and per-resource booking rules, re-read
+    # when it changes (checked at most every RULES_RELOAD_SECONDS).
+    'RULES_FILE': None,
+    'RULES_RELOAD_SECONDS': 2.0,
+    # Largest request body accepted, in bytes; larger ones get a 413 before
+    # any of the body is read.
+    'MAX_CONTENT_LENGTH': 16 * 1024,
+    # Responses at least this long (bytes) are sent gzip- or brotli-compressed
+    # to clients that accept it.
+    'COMPRESS_MIN_BYTES': 1024,
+    # Rendered listings (per data version) and the page, with their compressed
+    # variants, kept per worker.
+    'RESPONSE_CACHE_ENTRIES': 256,
+}
+
+# Bookings that don't name a resource go to this one (the original single server).
+DEFAULT_RESOURCE_NAME = 'default'
+
+# Blackout intervals are stored as reservations of this user, which clients cannot book as.
+BLACKOUT_USERNAME = 'maintenance'
+# Bookings default to priority 0; a higher one may displace lower-priority bookings.
+MAX_PRIORITY = 2
+
+# Length of a blackout's repeat period, by `recurrence`.
+BLACKOUT_PERIODS = {'daily': timedelta(days=1), 'weekly': timedelta(weeks=1)}
+
+MSGPACK = 'application/msgpack'
+
+# Reservation fields in MessagePack responses, in this order. Times are integer
+# seconds since the Unix epoch; absent values are nil.
+PACKED_FIELDS = ('id', 'resource_id', 'username', 'start_time', 'end_time',
+                 'hold_expires_at', 'blackout_id', 'priority')
+
+# Pooled allocation retries this many times when the index turns out stale.
+POOL_ALLOCATION_ATTEMPTS = 5
+
+# Default and maximum number of windows returned by GET /availability/next.
+NEXT_AVAILABLE_DEFAULT_LIMIT = 5
+NEXT_AVAILABLE_MAX_LIMIT = 50
+
+# Longest range, in days, that GET /availability maps at once.
+AVAILABILITY_MAX_DAYS = ADVANCE_BOOKING_LIMIT.days + 1
+
+# A 409 from POST /reservations lists at most this many conflicting reservations.
+CONFLICT_BLOCKER_LIMIT = 5
+# How far before and after a conflicting request its alternatives are searched for.
+CONFLICT_SEARCH_WINDOW = timedelta(days=1)
+
+# Default and maximum number of reservations returned by GET /reservations?view=history.
+HISTORY_DEFAULT_LIMIT = 100
+HISTORY_MAX_LIMIT = 1000
+
+# Longest range, in days, returned by GET /summary at once.
+SUMMARY_MAX_DAYS = 366
+
+# Default and maximum number of users listed by GET /analytics.
+ANALYTICS_DEFAULT_TOP = 10
+ANALYTICS_MAX_TOP = 100
+
+_DURATION_RE = re.compile(r'^(?:(\d+)h)?(?:(\d+)m)?$')
+
+def begin_booking():
+    """Starts the transaction that checks for conflicts and inserts a booking.
+
+    On SQLite the write lock is taken up front with BEGIN IMMEDIATE, so a second
+    booking waits for the first to commit before it runs its overlap query.
+    """
+    if db.engine.dialect.name == 'sqlite':
+        db.session.execute(text('BEGIN IMMEDIATE'))
+
+@bp.app_errorhandler(OperationalError)
+def database_busy(error):
+    """503 with Retry-After when SQLite's write lock wasn't free within the busy timeout.
+
+    Other database errors are not handled here and still give a 500.
+    """
+    if 'database is locked' not in str(error.orig):
+        raise error
+    db.session.rollback()
+    response = jsonify({"error": "The database is busy; retry shortly"})
+    response.headers['Retry-After'] = '1'
+    return response, 503
+
+def lock_resource(resource_id):
+    """Locks one resource's timeline and returns its current version.
+
+    Databases with row locks use SELECT ... FOR UPDATE, so only bookings for the
+    same resource serialize. SQLite is already locked by begin_booking().
+    """
+    query = db.session.query(Resource.version).filter_by(id=resource_id)
+    if db.engine.dialect.name != 'sqlite':
+        query = query.with_for_update()
+    return query.scalar()
+
+def bump_version(resource_id, version):
+    """Marks the resource's timeline as changed; returns the new version.
+
+    Every write to a resource's reservations goes through this in the same
+    transaction, so in-memory indexes in any worker can detect staleness.
+    """
+    Resource.query.filter_by(id=resource_id).update({Resource.version: version + 1})
+    return version + 1
+
+def find_nearby(resource_id, start_time, end_time, margin=timedelta(0)):
+    """Reservations on `resource_id` that overlap [start_time - margin, end_time + margin).
+
+    Ordered by start_time. No reservation is longer than MAX_RESERVATION_DURATION,
+    so anything that overlaps must start after the range start minus
+    MAX_RESERVATION_DURATION. That bound keeps the scan of the
+    (resource_id, start_time) index short.
+    """
+    return Reservation.query.filter(
+        Reservation.resource_id == resource_id,
+        Reservation.start_time > start_time - margin - MAX_RESERVATION_DURATION,
+        Reservation.start_time < end_time + margin,
+        Reservation.end_time > start_time - margin,
+        in_force(),
+    ).order_by(Reservation.start_time).all()
+
+def in_force():
+    """Filter for bookings and for holds that have not expired yet.
+
+    Holds are reservation rows with a deadline, so every conflict and
+    availability query already sees them. An expired hold stops counting at
+    once, even before the timing wheel deletes it.
+    """
+    return or_(Reservation.hold_expires_at.is_(None), Reservation.hold_expires_at > now_utc())
+
+class Resource(db.Model):
     id = db.Column(db.Integer, primary_key=True)
-    username = db.Column(db.String(80), nullable=False)
-    start_time = db.Column(db.DateTime, nullable=False)
-    end_time = db.Column(db.DateTime, nullable=False)
+    name = db.Column(db.String(80), nullable=False, unique=True)
+    # Optional pool name; "any one of" bookings pick a free member of a pool.
+    pool = db.Column(db.String(80), nullable=True, index=True)
+    # Incremented with every change to this resource's reservations.
+    version = db.Column(db.Integer, nullable=False, default=0, server_default='0')
 
     def __repr__(self):
-        return f'<Reservation {self.username} from {self.start_time} to {self.end_time}>'
+        return f'<Resource {self.name}>'
 
     def to_dict(self):
-        return {
-            'id': self.id,
-            'username': self.username,
-            'start_time': self.start_time.isoformat(),
-            'end_time': self.end_time.isoformat()
-        }
+        return {'id': self.id, 'name': self.name, 'pool': self.pool}
 
-@app.route('/reservations', methods=['POST'])
-def create_reservation():
-    data = request.get_json()
-    if not data:
-        return jsonify({"error": "Invalid input"}), 400
+class User(db.Model):
+    """Interned usernames; reservations and ledgers refer to users by id."""
+    id = db.Column(db.Integer, primary_key=True)
+    name = db.Column(db.String(80), nullable=False, unique=True)
 
-    username = data.get('username')
-    start_time_str = data.get('start_time')
-    end_time_str = data.get('end_time')
+    def __repr__(self):
+        return f'<User {self.name}>'
 
-    if not all([username, start_time_str, end_time_str]):
-        return jsonify({"error": "Missing required fields"}), 400
+def intern_user(name):
+    """Id of the user called `name`, creating the user on first use.
 
+    Ids never change, so names already in the database are cached per app. A
+    user created by this call is not cached until a later call finds it, in
+    case the surrounding transaction rolls back.
+    """
+    cache = current_app.extensions['user_ids']
+    user_id = cache.get(name)
+    if user_id is not None:
+        return user_id
+    user_id = db.session.query(User.id).filter_by(name=name).scalar()
+    if user_id is not None:
+        cache[name] = user_id
+        return user_id
     try:
-        # Parse and localize to PST. Assume input is naive and represents PST.
-        start_time = PST.localize(parser.isoparse(start_time_str))
-        end_time = PST.localize(parser.isoparse(end_time_str))
-    except ValueError:
-        return jsonify({"error": "Invalid date format. Use ISO format YYYY-MM-DD HH:MM"}), 400
+        with db.session.begin_nested():
+            user = User(name=name)
+            db.session.add(user)
+        return user.id
+    except IntegrityError:
+        # Another transaction created the same user first.
+        return db.session.query(User.id).filter_by(name=name).scalar()
 
-    now_pst = datetime.now(PST)
+def lock_user(user_id, skip_locked=False):
+    """Serializes one user's bookings on databases with row locks (see lock_resource).
 
-    # Validate: Start time must be in the future
-    if start_time <= now_pst:
-        return jsonify({"error": "Reservations can only be made for future dates/times"}), 400
+    With skip_locked, returns False instead of waiting when another transaction
+    holds the lock.
+    """
+    if db.engine.dialect.name != 'sqlite':
+        return db.session.query(User.id).filter_by(id=user_id).with_for_update(
+            skip_locked=skip_locked).scalar() is not None
+    return True
 
-    # Validate: End time must be after start time
-    if end_time <= start_time:
-        return jsonify({"error": "End time must be after start time"}), 400
+class Reservation(db.Model):
+    __table_args__ = (
+        db.Index('ix_reservation_resource_start', 'resource_id', 'start_time'),
+        db.Index('ix_reservation_user_start', 'user_id', 'start_time'),
+    )
 
-    # Validate: Minimum reservation duration
-    if (end_time - start_time) < MIN_RESERVATION_DURATION:
-        return jsonify({"error": f"Minimum reservation duration is {MIN_RESERVATION_DURATION.total_seconds() / 60} minutes"}), 400
+    id = db.Column(db.Integer, primary_key=True)
+    resource_id = db.Column(db.Integer, db.ForeignKey('resource.id'), nullable=False)
+    user_id = db.Column(db.Integer, db.ForeignKey('user.id'), nullable=False)
+    start_time = db.Column(db.DateTime, nullable=False)
+    end_time = db.Column(db.DateTime, nullable=False)
+    # Set (in UTC) while the row is an unconfirmed hold; NULL for bookings.
+    hold_expires_at = db.Column(db.DateTime, nullable=True)
+    # Set when the row is one piece of a blackout (see materialize_blackout()).
+    blackout_id = db.Column(db.Integer, db.ForeignKey('blackout.id'), nullable=True)
+    # 0 for normal bookings, up to MAX_PRIORITY (see preempt()).
+    priority = db.Column(db.Integer, nullable=False, default=0)
 
-    # Validate: Maximum reservation duration
-    if (end_time - start_time) > MAX_RESERVATION_DURATION:
-        return jsonify({"error": f"Maximum reservation duration is {MAX_RESERVATION_DURATION.total_seconds() / 3600} hours"}), 400
+    user = db.relationship(User, lazy='joined', innerjoin=True)
 
-    # Validate: Advance booking limit
-    if start_time > (now_pst + ADVANCE_BOOKING_LIMIT):
-        return jsonify({"error": f"Reservations can only be made up to {ADVANCE_BOOKING_LIMIT.days} days in advance"}), 400
+    def __repr__(self):
+        return f'<Reservation {self.user_id} on {self.resource_id} from {self.start_time} to {self.end_time}>'
 
-    # Validate: No overlapping reservations
-    overlapping_reservations = Reservation.query.filter(
-        (Reservation.start_time < end_time) & (Reservation.end_time > start_time)
-    ).all()
+    def to_dict(self):
+        # Times are stored as naive PST wall-clock values; the backend interprets
+        # all incoming naive strings as PST and reports them with their offset.
+        data = {
+            'id': self.id,
+            'resource_id': self.resource_id,
+            'username': self.user.name,
+            'start_time': format_local(self.start_time),
+            'end_time': format_local(self.end_time)
+        }
+        hold_expires_at = getattr(self, 'hold_expires_at', None)
+        if hold_expires_at is not None:
+            data['hold_expires_at'] = hold_expires_at.isoformat(timespec='seconds') + 'Z'
+        blackout_id = getattr(self, 'blackout_id', None)
+        if blackout_id is not None:
+            data['blackout_id'] = blackout_id
+        if getattr(self, 'priority', 0):
+            data['priority'] = self.priority
+        return data
 
-    if overlapping_reservations:
-        return jsonify({"error": "Requested time slot is already reserved or overlaps with an existing reservation"}), 409
+    def to_packed(self):
+        """Values of PACKED_FIELDS for MessagePack responses."""
+        hold_expires_at = getattr(self, 'hold_expires_at', None)
+        return (self.id, self.resource_id, self.user.name,
+                wall_to_epoch(self.start_time), wall_to_epoch(self.end_time),
+                None if hold_expires_at is None else utc_to_epoch(hold_expires_at),
+                getattr(self, 'blackout_id', None), getattr(self, 'priority', 0))
 
-    new_reservation = Reservation(username=username, start_time=start_time, end_time=end_time)
-    db.session.add(new_reservation)
-    db.session.commit()
+class ArchivedReservation(db.Model):
+    """Reservations moved out of the hot table by archive_expired(); ids are kept."""
+    __table_args__ = (
+        db.Index('ix_archived_reservation_start', 'start_time'),
+        db.Index('ix_archived_reservation_resource_start', 'resource_id', 'start_time'),
+    )
 
-    return jsonify(new_reservation.to_dict()), 201
+    id = db.Column(db.Integer, primary_key=True, autoincrement=False)
+    resource_id = db.Column(db.Integer, db.ForeignKey('resource.id'), nullable=False)
+    user_id = db.Column(db.Integer, db.ForeignKey('user.id'), nullable=False)
+    start_time = db.Column(db.DateTime, nullable=False)
+    end_time = db.Column(db.DateTime, nullable=False)
 
-@app.route('/reservations', methods=['GET'])
-def get_reservations():
-    view = request.args.get('view', 'all') # 'all', 'day', 'week'
-    now_pst = datetime.now(PST)
+    user = db.relationship(User, lazy='joined', innerjoin=True)
 
-    query = Reservation.query.filter(Reservation.end_time > now_pst) # Only future/active
+    to_dict = Reservation.to_dict
+    to_packed = Reservation.to_packed
 
-    if view == 'day':
-        today_start = now_pst.replace(hour=0, minute=0, second=0, microsecond=0)
-        today_end = today_start + timedelta(days=1)
-        query = query.filter(Reservation.start_time >= today_start, Reservation.start_time < today_end)
-    elif view == 'week':
-        # Start of the current week (assuming Monday is the first day)
-        week_start = (now_pst - timedelta(days=now_pst.weekday())).replace(hour=0, minute=0, second=0, microsecond=0)
-        week_end = week_start + timedelta(weeks=1)
-        query = query.filter(Reservation.start_time >= week_start, Reservation.start_time < week_end)
+class WaitlistEntry(db.Model):
+    """A request that was rejected with 409 and asked to wait for the interval.
 
-    reservations = query.order_by(Reservation.start_time).all()
-    return jsonify([r.to_dict() for r in reservations]), 200
+    When a reservation on the resource is removed, promote_waiters() books the
+    oldest entries that now fit, in the same transaction.
+    """
+    __tablename__ = 'waitlist_entry'
+    __table_args__ = (
+        db.Index('ix_waitlist_entry_resource_start', 'resource_id', 'start_time'),
+        db.Index('ix_waitlist_entry_user_start', 'user_id', 'start_time'),
+    )
 
-from flask import Flask, request, jsonify, render_template # Added render_template
-from flask_sqlalchemy import SQLAlchemy
-from datetime import datetime, timedelta
-import pytz
-from dateutil import parser
+    id = db.Column(db.Integer, primary_key=True)
+    resource_id = db.Column(db.Integer, db.ForeignKey('resource.id'), nullable=False)
+    user_id = db.Column(db.Integer, db.ForeignKey('user.id'), nullable=False)
+    start_time = db.Column(db.DateTime, nullable=False)
+    end_time = db.Column(db.DateTime, nullable=False)
 
-app = Flask(__name__)
-app.config['SQLALCHEMY_DATABASE_URI'] = 'sqlite:///reservations.db'
-app.config['SQLALCHEMY_TRACK_MODIFICATIONS'] = False
-db = SQLAlchemy(app)
+    user = db.relationship(User, lazy='joined', innerjoin=True)
 
-# Define the PST timezone
-PST = pytz.timezone('America/Los_Angeles')
+    to_dict = Reservation.to_dict
 
-# Maximum reservation duration (e.g., 4 hours)
-MAX_RESERVATION_DURATION = timedelta(hours=4)
-# Minimum time slot (15 minutes)
-MIN_RESERVATION_DURATION = timedelta(minutes=15)
-# Advance booking limit (30 days)
-ADVANCE_BOOKING_LIMIT = timedelta(days=30)
+class Blackout(db.Model):
+    """A maintenance window on one resource, either once or repeating daily or weekly.
 
-class Reservation(db.Model):
+    Occurrences are written as reservation rows (at most MAX_RESERVATION_DURATION
+    each) for the booking horizon. Conflict checks, availability and the
+    schedule index therefore see them like any booking.
+    """
     id = db.Column(db.Integer, primary_key=True)
-    username = db.Column(db.String(80), nullable=False)
+    resource_id = db.Column(db.Integer, db.ForeignKey('resource.id'), nullable=False)
+    # First occurrence, as naive PST wall-clock times.
     start_time = db.Column(db.DateTime, nullable=False)
     end_time = db.Column(db.DateTime, nullable=False)
+    # None, 'daily' or 'weekly'; `until` is the last day an occurrence may start.
+    recurrence = db.Column(db.String(16), nullable=True)
+    until = db.Column(db.Date, nullable=True)
+    reason = db.Column(db.String(200), nullable=True)
+    # Occurrences starting before this have been materialized.
+    materialized_until = db.Column(db.DateTime, nullable=False)
 
-    def __repr__(self):
-        return f'<Reservation {self.username} from {self.start_time} to {self.end_time}>'
+    def occurrences(self, start, end):
+        """(start, end) of each occurrence that starts in [start, end)."""
+        period = BLACKOUT_PERIODS.get(self.recurrence)
+        length = self.end_time - self.start_time
+        occurrence = self.start_time
+        if period is not None and occurrence < start:
+            occurrence += -((self.start_time - start) // period) * period
+        while occurrence < end and (self.until is None or occurrence.date() <= self.until):
+            if occurrence >= start:
+                yield occurrence, occurrence + length
+            if period is None:
+                return
+            occurrence += period
 
     def to_dict(self):
-        # Ensure times are converted to PST for consistent ISO format output if they are timezone-aware
-        # If stored as naive in DB but representing PST, localize before formatting
-        # If stored as UTC, convert to PST then format
+        return {
+            'id': self.id,
+            'resource_id': self.resource_id,
+            'start_time': format_local(self.start_time),
+            'end_time': format_local(self.end_time),
+            'recurrence': self.recurrence,
+            'until': self.until.isoformat() if self.until else None,
+            'reason': self.reason,
+        }
 
-        # Assuming start_time and end_time from DB are already correct (e.g. stored as UTC or naive PST)
-        # For this example, the backend logic localizes to PST upon creation.
-        # So, they should be PST-aware datetime objects.
+class Notification(db.Model):
+    """A message for a user about a change they did not make, e.g. a preempted booking."""
+    __table_args__ = (
+        db.Index('ix_notification_user_created', 'user_id', 'created_at'),
+    )
 
-        # No, the model stores naive datetimes after they've been converted from strings.
-        # The API converts them to ISO strings directly.
-        # The critical part is that the backend *interprets* incoming naive strings as PST.
-        # And stores timezone-aware datetimes in the DB if the DB & SQLAlchemy support it,
-        # or converts to UTC then stores naive, or stores naive PST.
-        # Given current code, they are stored as timezone-aware after PST.localize().
+    id = db.Column(db.Integer, primary_key=True)
+    user_id = db.Column(db.Integer, db.ForeignKey('user.id'), nullable=False)
+    # Not a foreign key: the reservation may have been cancelled.
+    reservation_id = db.Column(db.Integer, nullable=True)
+    created_at = db.Column(db.DateTime, nullable=False)  # UTC
+    message = db.Column(db.String(300), nullable=False)
 
+    def to_dict(self):
         return {
             'id': self.id,
-            'username': self.username,
-            'start_time': self.start_time.isoformat(), # Will include +00:00 if UTC, or -07:00/-08:00 if PST
-            'end_time': self.end_time.isoformat()
+            'reservation_id': self.reservation_id,
+            'created_at': self.created_at.isoformat(timespec='seconds') + 'Z',
+            'message': self.message,
+        }
+
+class DailySummary(db.Model):
+    """Occupancy of one resource on one PST day, maintained by summarize().
+
+    A reservation that crosses midnight counts towards each day it covers, with
+    the minutes, first start and last end clipped to that day.
+    """
+    __tablename__ = 'daily_summary'
+    __table_args__ = (
+        db.Index('ix_daily_summary_day', 'day'),
+    )
+
+    resource_id = db.Column(db.Integer, db.ForeignKey('resource.id'), primary_key=True)
+    day = db.Column(db.Date, primary_key=True)
+    booked_minutes = db.Column(db.Integer, nullable=False, default=0)
+    reservation_count = db.Column(db.Integer, nullable=False, default=0)
+    first_start = db.Column(db.DateTime, nullable=False)
+    last_end = db.Column(db.DateTime, nullable=False)
+
+    def to_dict(self):
+        return {
+            'resource_id': self.resource_id,
+            'day': self.day.isoformat(),
+            'booked_minutes': self.booked_minutes,
+            'reservation_count': self.reservation_count,
+            'first_start': format_local(self.first_start),
+            'last_end': format_local(self.last_end),
         }
 
-@app.route('/reservations', methods=['POST'])
+class HourlyUsage(db.Model):
+    """Booked minutes of one resource in one wall-clock hour, maintained by summarize()."""
+    __tablename__ = 'hourly_usage'
+    __table_args__ = (
+        db.Index('ix_hourly_usage_day', 'day'),
+    )
+
+    resource_id = db.Column(db.Integer, db.ForeignKey('resource.id'), primary_key=True)
+    day = db.Column(db.Date, primary_key=True)
+    hour = db.Column(db.Integer, primary_key=True)
+    booked_minutes = db.Column(db.Integer, nullable=False, default=0)
+
+class BookingRejection(db.Model):
+    """One POST /reservations answered with 409, for the rejection rate in analytics."""
+    __table_args__ = (
+        db.Index('ix_booking_rejection_start', 'start_time'),
+    )
+
+    id = db.Column(db.Integer, primary_key=True)
+    # The requested resource, or the pool for pooled bookings.
+    resource_id = db.Column(db.Integer, db.ForeignKey('resource.id'), nullable=True)
+    pool = db.Column(db.String(80), nullable=True)
+    start_time = db.Column(db.DateTime, nullable=False)
+    end_time = db.Column(db.DateTime, nullable=False)
+
+def record_rejection(start, end, resource_id=None, pool=None):
+    """Logs a 409 in the booking transaction, which the caller then commits.
+
+    The log is insert-only, so concurrent rejections never wait on each other.
+    """
+    db.session.add(BookingRejection(resource_id=resource_id, pool=pool, start_time=start, end_time=end))
+
+class UsageLedger(db.Model):
+    """Booked minutes and reservation count of one user in one PST week.
+
+    Weeks start on Monday; a reservation is charged to the week it starts in.
+    Maintained by charge_usage() in the booking transaction, so quota checks are
+    a primary-key lookup instead of a SUM over the user's reservations.
+    """
+    __tablename__ = 'usage_ledger'
+
+    user_id = db.Column(db.Integer, db.ForeignKey('user.id'), primary_key=True)
+    week = db.Column(db.Date, primary_key=True)
+    booked_minutes = db.Column(db.Integer, nullable=False, default=0)
+    reservation_count = db.Column(db.Integer, nullable=False, default=0)
+
+def week_of(wall):
+    """Monday of the PST week containing a naive wall-clock time."""
+    return (wall - timedelta(days=wall.weekday())).date()
+
+def reserved_minutes(start, end):
+    return (wall_to_epoch(end) - wall_to_epoch(start)) // 60
+
+def check_quota(user_id, start, end, now, replacing=None):
+    """Error message if booking [start, end) would break a per-user quota, else None.
+
+    Runs inside the booking transaction after lock_user(), before the
+    reservation is added. With `replacing`, the check is for moving that
+    reservation to [start, end): its own minutes are not counted and it does
+    not add to the active count.
+    """
+    weekly_hours = current_app.config['QUOTA_WEEKLY_HOURS']
+    if weekly_hours is not None:
+        entry = db.session.get(UsageLedger, (user_id, week_of(start)))
+        used = entry.booked_minutes if entry else 0
+        if replacing is not None and week_of(replacing.start_time) == week_of(start):
+            used -= reserved_minutes(replacing.start_time, replacing.end_time)
+        if used + reserved_minutes(start, end) > weekly_hours * 60:
+            return (f"Weekly quota of {weekly_hours:g} hours exceeded "
+                    f"({used / 60:g} hours already booked in the week of {week_of(start).isoformat()})")
+    max_active = current_app.config['QUOTA_ACTIVE_RESERVATIONS']
+    if max_active is not None and replacing is None:
+        # Reservations that have not ended started after now - MAX_RESERVATION_DURATION,
+        # so this is a range scan of the (user_id, start_time) index that stops
+        # after max_active rows.
+        active = db.session.query(Reservation.id).filter(
+            Reservation.user_id == user_id,
+            Reservation.start_time > now - MAX_RESERVATION_DURATION,
+            Reservation.end_time > now,
+            in_force(),
+        ).limit(max_active).subquery()
+        if db.session.query(func.count()).select_from(active).scalar() >= max_active:
+            return f"At most {max_active} active reservations per user"
+    return None
+
+def charge_usage(user_id, start, end, added=True):
+    """Adds (or, with added=False, refunds) one reservation in the user's usage ledger."""
+    week = week_of(start)
+    entry = db.session.get(UsageLedger, (user_id, week))
+    if entry is None:
+        if not added:
+            return
+        entry = UsageLedger(user_id=user_id, week=week, booked_minutes=0, reservation_count=0)
+        db.session.add(entry)
+    sign = 1 if added else -1
+    entry.booked_minutes += sign * reserved_minutes(start, end)
+    entry.reservation_count += sign
+
+def rebuild_usage_ledger():
+    """Recomputes usage_ledger from live reservations."""
+    UsageLedger.query.delete()
+    for user_id, start, end in db.session.query(
+            Reservation.user_id, Reservation.start_time, Reservation.end_time).filter(
+            Reservation.blackout_id.is_(None)).yield_per(500):
+        charge_usage(user_id, start, end)
+    db.session.commit()
+
+def day_segments(start, end):
+    """Splits [start, end) at PST midnights into (day, segment_start, segment_end)."""
+    day_start = datetime.combine(start.date(), datetime.min.time())
+    while day_start < end:
+        next_day = day_start + timedelta(days=1)
+        yield day_start.date(), max(start, day_start), min(end, next_day)
+        day_start = next_day
+
+def hour_segments(start, end):
+    """Splits [start, end) at wall-clock hours into (hour, segment_start, segment_end)."""
+    hour_start = start.replace(minute=0, second=0, microsecond=0)
+    while hour_start < end:
+        next_hour = hour_start + timedelta(hours=1)
+        yield hour_start, max(start, hour_start), min(end, next_hour)
+        hour_start = next_hour
+
+def summarize_hours(resource_id, start, end, added):
+    sign = 1 if added else -1
+    for hour, segment_start, segment_end in hour_segments(start, end):
+        minutes = int((segment_end - segment_start).total_seconds()) // 60
+        key = (resource_id, hour.date(), hour.hour)
+        row = db.session.get(HourlyUsage, key)
+        if row is None:
+            if not added:
+                continue
+            row = HourlyUsage(resource_id=resource_id, day=key[1], hour=key[2], booked_minutes=0)
+            db.session.add(row)
+        row.booked_minutes += sign * minutes
+        if row.booked_minutes <= 0 and not added:
+            db.session.delete(row)
+
+def summarize(resource_id, start, end, added=True):
+    """Adds (or, with added=False, removes) one reservation in daily_summary and hourly_usage.
+
+    Must run in the transaction that inserts or deletes the reservation. That
+    transaction holds the resource lock, so the resource's summary rows have a
+    single writer. On removal the reservation must already be deleted from the
+    session, in case a day's first start or last end has to be recomputed.
+    """
+    summarize_hours(resource_id, start, end, added)
+    for day, segment_start, segment_end in day_segments(start, end):
+        minutes = reserved_minutes(segment_start, segment_end)
+        row = db.session.get(DailySummary, (resource_id, day))
+        if added:
+            if row is None:
+                row = DailySummary(resource_id=resource_id, day=day, booked_minutes=0, reservation_count=0,
+                                   first_start=segment_start, last_end=segment_end)
+                db.session.add(row)
+            row.booked_minutes += minutes
+            row.reservation_count += 1
+            row.first_start = min(row.first_start, segment_start)
+            row.last_end = max(row.last_end, segment_end)
+        elif row is not None:
+            row.booked_minutes -= minutes
+            row.reservation_count -= 1
+            if row.reservation_count <= 0:
+                db.session.delete(row)
+            elif segment_start == row.first_start or segment_end == row.last_end:
+                bounds = day_bounds(resource_id, day)
+                if bounds is None:
+                    db.session.delete(row)
+                else:
+                    row.first_start, row.last_end = bounds
+
+def day_bounds(resource_id, day):
+    """First start and last end, clipped to `day`, of the reservations daily_summary counts there.
+
+    Those are the rows rebuild_daily_summary() reads, live and archived, without
+    blackouts. Expired holds the sweeper hasn't reached yet are still counted,
+    so in_force() does not apply. Returns None if there are none.
+    """
+    day_start = datetime.combine(day, datetime.min.time())
+    next_day = day_start + timedelta(days=1)
+    firsts, lasts = [], []
+    for model in (Reservation, ArchivedReservation):
+        query = db.session.query(func.min(model.start_time), func.max(model.end_time)).filter(
+            model.resource_id == resource_id,
+            model.start_time > day_start - MAX_RESERVATION_DURATION,
+            model.start_time < next_day,
+            model.end_time > day_start,
+        )
+        if model is Reservation:
+            query = query.filter(Reservation.blackout_id.is_(None))
+        first, last = query.one()
+        if first is not None:
+            firsts.append(max(first, day_start))
+            lasts.append(min(last, next_day))
+    if not firsts:
+        return None
+    return min(firsts), max(lasts)
+
+def rebuild_daily_summary():
+    """Recomputes daily_summary and hourly_usage from live and archived reservations."""
+    DailySummary.query.delete()
+    HourlyUsage.query.delete()
+    for model in (Reservation, ArchivedReservation):
+        query = db.session.query(model.resource_id, model.start_time, model.end_time)
+        if model is Reservation:
+            query = query.filter(Reservation.blackout_id.is_(None))
+        for resource_id, start, end in query.yield_per(500):
+            summarize(resource_id, start, end)
+    db.session.commit()
+
+def remove_reservation(reservation, version):
+    """Deletes a reservation with its summary and ledger entries; returns the new version.
+
+    The caller holds the booking locks and `version` is the locked resource
+    version. After committing, apply the same change to the schedule index
+    with unrecord().
+    """
+    resource_id, user_id = reservation.resource_id, reservation.user_id
+    start, end = reservation.start_time, reservation.end_time
+    db.session.delete(reservation)
+    db.session.flush()
+    summarize(resource_id, start, end, added=False)
+    charge_usage(user_id, start, end, added=False)
+    return bump_version(resource_id, version)
+
+def resize_reservation(reservation, start, end, version):
+    """Changes a reservation to [start, end) in place, with its summary and ledger entries.
+
+    Returns the new version. The new interval is added before the old one is
+    removed, so shared summary rows are never deleted and re-created. After
+    committing, apply the change to the schedule index with move().
+    """
+    resource_id, user_id = reservation.resource_id, reservation.user_id
+    old_start, old_end = reservation.start_time, reservation.end_time
+    reservation.start_time, reservation.end_time = start, end
+    db.session.flush()
+    summarize(resource_id, start, end)
+    summarize(resource_id, old_start, old_end, added=False)
+    charge_usage(user_id, start, end)
+    charge_usage(user_id, old_start, old_end, added=False)
+    return bump_version(resource_id, version)
+
+def promote_waiters(resource_id, start, end):
+    """Books waitlisted requests that fit now that [start, end) on `resource_id` is free.
+
+    Runs in the transaction that freed the interval, with the resource locked.
+    Only entries overlapping the freed interval can have been waiting for it, so
+    they come from a range scan of (resource_id, start_time) bounded by
+    MAX_RESERVATION_DURATION. Oldest entries are tried first. An entry that
+    still conflicts, or would break its user's quota, keeps waiting. A booked
+    entry's user gets a Notification. Returns
+    [(reservation, version)] to pass to apply_booking() after the commit.
+    """
+    now = now_pst().replace(tzinfo=None)
+    candidates = WaitlistEntry.query.filter(
+        WaitlistEntry.resource_id == resource_id,
+        WaitlistEntry.start_time > max(now, start - MAX_RESERVATION_DURATION),
+        WaitlistEntry.start_time < end,
+        WaitlistEntry.end_time > start,
+    ).order_by(WaitlistEntry.id).all()
+    promoted = []
+    for entry in candidates:
+        # The resource is locked before the waiter, against the usual order, so
+        # a waiter busy booking elsewhere is skipped rather than waited for.
+        if find_nearby(resource_id, entry.start_time, entry.end_time) or not lock_user(entry.user_id, skip_locked=True):
+            continue
+        booked, error = try_booking(entry.user_id, resource_id, None, entry.start_time, entry.end_time, now)
+        if error:
+            continue
+        db.session.delete(entry)
+        db.session.add(Notification(
+            user_id=entry.user_id, reservation_id=booked[0].id, created_at=now_utc(),
+            message=(f"Your waitlisted request was booked as reservation {booked[0].id}: "
+                     f"{format_local(entry.start_time)} - {format_local(entry.end_time)}")))
+        promoted.append(booked)
+    return promoted
+
+def cancel_reservation(reservation):
+    """Deletes a reservation or hold, promotes waiters and commits.
+
+    begin_booking() must already have been called.
+    """
+    lock_user(reservation.user_id)
+    version = lock_resource(reservation.resource_id)
+    resource_id, start, end = reservation.resource_id, reservation.start_time, reservation.end_time
+    version = remove_reservation(reservation, version)
+    promoted = promote_waiters(resource_id, start, end)
+    db.session.commit()
+    schedule_index().unrecord(resource_id, start, end, version)
+    for booked in promoted:
+        apply_booking(*booked)
+
+def expire_holds(hold_ids):
+    """Releases the given holds that are still unconfirmed and past their deadline.
+
+    Each hold gets its own short booking transaction. Returns how many were released.
+    """
+    released = 0
+    for hold_id in hold_ids:
+        begin_booking()
+        hold = db.session.get(Reservation, hold_id)
+        if hold is None or hold.hold_expires_at is None or hold.hold_expires_at > now_utc():
+            db.session.rollback()
+            continue
+        cancel_reservation(hold)
+        released += 1
+    return released
+
+def hold_wheel():
+    return current_app.extensions['hold_wheel']
+
+def hold_deadline(utc):
+    # utc_to_epoch() truncates; rounding up keeps the wheel from firing before the hold is due.
+    return utc_to_epoch(utc) + 1
+
+def schedule_pending_holds(wheel):
+    """Puts every hold in the database on the wheel, e.g. after a restart."""
+    rows = db.session.query(Reservation.id, Reservation.hold_expires_at).filter(
+        Reservation.hold_expires_at.isnot(None))
+    for hold_id, deadline in rows:
+        wheel.schedule(hold_id, hold_deadline(deadline))
+
+def start_hold_sweeper(app):
+    """Releases expired holds as the timing wheel reports them, on a daemon thread.
+
+    Each worker sweeps the holds it placed plus those pending when it started,
+    so no query ever scans for expired holds. A hold released twice by
+    two workers is a no-op the second time.
+    """
+    wheel = app.extensions['hold_wheel']
+    interval = app.config['HOLD_SWEEP_SECONDS']
+
+    def run():
+        with app.app_context():
+            try:
+                schedule_pending_holds(wheel)
+            except Exception:
+                app.logger.exception('Loading pending holds failed')
+            finally:
+                db.session.remove()
+        while True:
+            time.sleep(interval)
+            expired = wheel.advance()
+            if not expired:
+                continue
+            with app.app_context():
+                try:
+                    expire_holds(expired)
+                except Exception:
+                    db.session.rollback()
+                    app.logger.exception('Releasing expired holds failed')
+                    retry_at = time.time() + 10 * interval
+                    for hold_id in expired:
+                        wheel.schedule(hold_id, retry_at)
+                finally:
+                    db.session.remove()
+
+    threading.Thread(target=run, name='hold-sweeper', daemon=True).start()
+
+def archive_expired(now, retention, batch_size):
+    """Moves reservations that ended before `now - retention` to the archive table.
+
+    Each batch of up to `batch_size` rows is copied and deleted in its own short
+    write transaction, so bookings queue behind at most one batch. Archived rows
+    lie entirely in the past, where no conflict check or schedule index looks,
+    so resource versions are left alone. Returns the number of rows moved.
+    """
+    cutoff = now - retention
+    columns = ['id', 'resource_id', 'user_id', 'start_time', 'end_time']
+    moved = 0
+    while True:
+        begin_booking()
+        ids = [rid for (rid,) in db.session.query(Reservation.id)
+               .filter(Reservation.end_time <= cutoff, Reservation.hold_expires_at.is_(None),
+                       Reservation.blackout_id.is_(None))
+               .order_by(Reservation.id).limit(batch_size)]
+        if ids:
+            source = select(*(getattr(Reservation, c) for c in columns)).where(Reservation.id.in_(ids))
+            db.session.execute(insert(ArchivedReservation).from_select(columns, source))
+            db.session.execute(delete(Reservation).where(Reservation.id.in_(ids)))
+        db.session.commit()
+        moved += len(ids)
+        if len(ids) < batch_size:
+            return moved
+
+def archive_pass(app):
+    """One archive_expired() run with the app's retention settings.
+
+    Also drops waitlist entries whose start has passed (they can never be
+    promoted) and blackout pieces past retention (they are not archived), and
+    materializes blackouts for the day that has entered the booking horizon.
+    """
+    now = now_pst().replace(tzinfo=None)
+    retention = timedelta(days=app.config['ARCHIVE_RETENTION_DAYS'])
+    WaitlistEntry.query.filter(WaitlistEntry.start_time <= now).delete()
+    Reservation.query.filter(Reservation.blackout_id.isnot(None), Reservation.end_time <= now - retention).delete()
+    db.session.commit()
+    materialize_blackouts(now)
+    return archive_expired(now, retention, app.config['ARCHIVE_BATCH_SIZE'])
+
+def blackout_horizon(now):
+    """Blackouts are materialized this far ahead: one day past the booking horizon,
+    so the new day is covered even if a pass runs late."""
+    return advance_booking_cutoff(now) + timedelta(days=1)
+
+def blackout_pieces(start, end):
+    """Splits [start, end) into pieces of at most MAX_RESERVATION_DURATION.
+
+    Conflict queries look back only MAX_RESERVATION_DURATION from the requested
+    start, so no stored row may be longer than that.
+    """
+    while start < end:
+        piece_end = min(end, start + MAX_RESERVATION_DURATION)
+        yield start, piece_end
+        start = piece_end
+
+def materialize_blackout(blackout, horizon, user_id):
+    """Writes the occurrences of `blackout` that start before `horizon` as reservation rows.
+
+    Runs in a booking transaction with the resource locked. Returns the
+    reservations that overlap a piece; when there are any, nothing is written.
+    """
+    pieces = [piece for occurrence in blackout.occurrences(blackout.materialized_until, horizon)
+              for piece in blackout_pieces(*occurrence)]
+    conflicts = [r for piece in pieces for r in find_nearby(blackout.resource_id, *piece)]
+    if conflicts:
+        return conflicts
+    for start, end in pieces:
+        db.session.add(Reservation(resource_id=blackout.resource_id, user_id=user_id,
+                                   start_time=start, end_time=end, blackout_id=blackout.id))
+    # A one-off blackout, or one past its `until`, never needs another pass.
+    finished = ((blackout.recurrence is None and blackout.start_time < horizon)
+                or (blackout.until is not None and horizon.date() > blackout.until))
+    blackout.materialized_until = datetime.max if finished else max(blackout.materialized_until, horizon)
+    return []
+
+def materialize_blackouts(now):
+    """Extends every blackout to the current horizon, one resource per transaction.
+
+    An occurrence that would overlap a booking (possible only if the advance
+    booking limit was raised) is logged and left unmaterialized.
+    """
+    horizon = blackout_horizon(now)
+    resource_ids = [rid for (rid,) in db.session.query(Blackout.resource_id).filter(
+        Blackout.materialized_until < horizon).distinct()]
+    user_id = intern_user(BLACKOUT_USERNAME)
+    db.session.commit()
+    for resource_id in resource_ids:
+        begin_booking()
+        version = lock_resource(resource_id)
+        for blackout in Blackout.query.filter(Blackout.resource_id == resource_id,
+                                              Blackout.materialized_until < horizon):
+            if materialize_blackout(blackout, horizon, user_id):
+                current_app.logger.warning('Blackout %s overlaps bookings; not materialized', blackout.id)
+        bump_version(resource_id, version)
+        db.session.commit()
+        schedule_index().invalidate(resource_id)
+
+def start_archiver(app):
+    """Runs archive_pass() every ARCHIVE_INTERVAL_SECONDS on a daemon thread."""
+    interval = app.config['ARCHIVE_INTERVAL_SECONDS']
+
+    def run():
+        while True:
+            time.sleep(interval)
+            with app.app_context():
+                try:
+                    archive_pass(app)
+                except Exception:
+                    db.session.rollback()
+                    app.logger.exception('Archiving expired reservations failed')
+                finally:
+                    db.session.remove()
+
+    threading.Thread(target=run, name='reservation-archiver', daemon=True).start()
+
+@click.command('archive')
+@with_appcontext
+def archive_command():
+    """Moves reservations past the retention window to the archive table."""
+    click.echo(f'Archived {archive_pass(current_app)} reservations')
+
+def advance_booking_cutoff(now, limit=ADVANCE_BOOKING_LIMIT):
+    """First naive wall-clock time that is too far ahead to book.
+
+    Reservations can be made up to `limit` (default ADVANCE_BOOKING_LIMIT) days
+    in the future. This means if today is Day 0, the latest reservable day is
+    Day 30. The start_time must be before the beginning of Day 31.
+    Computed in wall-clock time so a DST change inside the window does not
+    shift the cutoff away from midnight.
+    """
+    return (now.replace(hour=0, minute=0, second=0, microsecond=0, tzinfo=None) +
+            limit +
+            timedelta(days=1))
+
+def booking_rules(resource_id=None, pool=None):
+    """Compiled RuleSet for a resource, or for a pool before a member is chosen."""
+    book = current_app.extensions['rules']
+    if pool is not None:
+        return book.for_pool(pool)
+    return book.for_resource(resource_id, lambda: db.session.query(Resource.name, Resource.pool)
+                             .filter_by(id=resource_id).one())
+
+def parse_duration(value):
+    """Parses '90m', '1h30m', '2h' or plain minutes ('90') into a timedelta."""
+    if value is None:
+        raise ValueError('missing duration')
+    if value.isdigit():
+        return timedelta(minutes=int(value))
+    match = _DURATION_RE.match(value)
+    if not value or not match:
+        raise ValueError(f'invalid duration: {value!r}')
+    hours, minutes = match.groups()
+    return timedelta(hours=int(hours or 0), minutes=int(minutes or 0))
+
+def ceil_to_slot(wall):
+    """Rounds a naive wall-clock time up to the next SLOT boundary."""
+    step = int(SLOT.total_seconds() // 60)
+    floor = wall.replace(minute=wall.minute - wall.minute % step, second=0, microsecond=0)
+    return floor if floor == wall else floor + SLOT
+
+def bookable_start(wall):
+    """First slot boundary at or after `wall` that exists and is unambiguous in PST."""
+    wall = ceil_to_slot(wall)
+    while True:
+        try:
+            wall_offset(wall)
+            return wall
+        except ValueError:
+            wall += SLOT
+
+def iter_free_windows(resource_id, after, cutoff, duration):
+    """Yields the first bookable (start, end, gap_end) in each free gap of a resource.
+
+    Reads the resource's reservations once, in start_time order from the
+    (resource_id, start_time) index, and walks the gaps between them. Windows
+    start on SLOT boundaries at or after `after` and before `cutoff`. gap_end is
+    None for the open gap after the last reservation.
+    """
+    rows = db.session.query(Reservation.start_time, Reservation.end_time).filter(
+        Reservation.resource_id == resource_id,
+        Reservation.start_time > after - MAX_RESERVATION_DURATION,
+        Reservation.end_time > after,
+        in_force(),
+    ).order_by(Reservation.start_time).yield_per(64)
+
+    def first_fit(gap_start, gap_end):
+        start = bookable_start(gap_start)
+        while start < cutoff:
+            end = add_elapsed(start, duration)
+            if gap_end is not None and end > gap_end:
+                return None
+            try:
+                wall_offset(end)
+                return start, end, gap_end
+            except ValueError:
+                start = bookable_start(start + SLOT)
+        return None
+
+    cursor = after
+    for busy_start, busy_end in rows:
+        if cursor >= cutoff:
+            return
+        if busy_start > cursor:
+            window = first_fit(cursor, busy_start)
+            if window:
+                yield window
+        cursor = max(cursor, busy_end)
+    if cursor < cutoff:
+        window = first_fit(cursor, None)
+        if window:
+            yield window
+
+def conflict_details(resource_id, nearby, start, end, now, cutoff):
+    """Body of a 409 for [start, end) on a resource (naive wall-clock times).
+
+    `nearby` is the find_nearby() result for the request with a margin of
+    CONFLICT_SEARCH_WINDOW, so the blockers and the nearest earlier and later
+    free windows of the same elapsed duration come from that one query.
+    Alternatives start on SLOT boundaries; either may be None when nothing fits
+    within the search window, the future and the advance booking limit.
+    """
+    blockers = [r for r in nearby if r.start_time < end and r.end_time > start]
+    busy = Timeline([(r.start_time, r.end_time) for r in nearby])
+
+    def formatted(window):
+        return window and {"start_time": format_local(window[0]), "end_time": format_local(window[1])}
+
+    earlier, later = nearest_windows(busy, start, end, now, cutoff)
+    return {
+        "error": "Requested time slot is already reserved or overlaps with an existing reservation",
+        "resource_id": resource_id,
+        "conflicts": [r.to_dict() for r in blockers[:CONFLICT_BLOCKER_LIMIT]],
+        "conflict_count": len(blockers),
+        "alternatives": {"earlier": formatted(earlier), "later": formatted(later)},
+    }
+
+def nearest_windows(busy, start, end, now, cutoff):
+    """Nearest free (start, end) windows before and after [start, end) in the Timeline `busy`.
+
+    Windows have the same elapsed duration, start on SLOT boundaries and lie
+    within CONFLICT_SEARCH_WINDOW, the future and the advance booking limit;
+    either may be None.
+    """
+    duration = localize(end) - localize(start)
+
+    def window(candidate):
+        try:
+            wall_offset(candidate)
+            candidate_end = add_elapsed(candidate, duration)
+            wall_offset(candidate_end)
+        except ValueError:
+            return None
+        if busy.is_free(candidate, candidate_end):
+            return candidate, candidate_end
+        return None
+
+    earlier = later = None
+    candidate = ceil_to_slot(start) - SLOT
+    while earlier is None and candidate > now and candidate >= start - CONFLICT_SEARCH_WINDOW:
+        earlier = window(candidate)
+        candidate -= SLOT
+    candidate = ceil_to_slot(start)
+    if candidate == start:
+        candidate += SLOT
+    while later is None and candidate < cutoff and add_elapsed(candidate, duration) <= end + CONFLICT_SEARCH_WINDOW:
+        later = window(candidate)
+        candidate += SLOT
+    return earlier, later
+
+def unavailable_slots(resource_id, first, days, now, cutoff):
+    """Marks each SLOT of `days` wall-clock days from `first` as bookable (0) or not (1).
+
+    A slot is unavailable when any reservation overlaps it, when it starts at or
+    before `now` or at/after the advance booking `cutoff`, or when its start is
+    skipped or repeated by a DST change. Reservations come from one range query
+    on the (resource_id, start_time) index.
+    """
+    n = days * int(timedelta(days=1) / SLOT)
+    last = first + n * SLOT
+    taken = bytearray(n)
+    rows = db.session.query(Reservation.start_time, Reservation.end_time).filter(
+        Reservation.resource_id == resource_id,
+        Reservation.start_time > first - MAX_RESERVATION_DURATION,
+        Reservation.start_time < last,
+        Reservation.end_time > first,
+        in_force(),
+    )
+    for start, end in rows:
+        lo = max(0, (start - first) // SLOT)
+        hi = min(n, -((first - end) // SLOT))
+        taken[lo:hi] = b'\x01' * (hi - lo)
+
+    if now >= first:
+        past = min(n, (now - first) // SLOT + 1)
+        taken[:past] = b'\x01' * past
+    beyond = max(0, -((first - cutoff) // SLOT))
+    if beyond < n:
+        taken[beyond:] = b'\x01' * (n - beyond)
+
+    for i in range(n):
+        if not taken[i]:
+            try:
+                wall_offset(first + i * SLOT)
+            except ValueError:
+                taken[i] = 1
+    return taken
+
+def run_lengths(bits):
+    """Alternating run lengths of 0s and 1s, always starting with a (possibly empty) run of 0s."""
+    runs = [len(list(group)) for _, group in groupby(bits)]
+    return [0] + runs if bits and bits[0] else runs
+
+def default_resource_id():
+    return db.session.query(Resource.id).filter_by(name=DEFAULT_RESOURCE_NAME).scalar()
+
+def schedule_index():
+    return current_app.extensions['schedule_index']
+
+def load_timelines(index, versions):
+    """Loads upcoming reservations for {resource_id: version} into the index in one query."""
+    intervals = {rid: [] for rid in versions}
+    rows = db.session.query(Reservation.resource_id, Reservation.start_time, Reservation.end_time).filter(
+        Reservation.resource_id.in_(list(versions)),
+        Reservation.end_time > now_pst().replace(tzinfo=None),
+        in_force(),
+    )
+    for rid, start, end in rows:
+        intervals[rid].append((start, end))
+    for rid, version in versions.items():
+        index.load(rid, version, intervals[rid])
+
+def sync_pool(index, pool, force=False):
+    """Refreshes pool membership and reloads members whose version moved."""
+    if not force and not index.needs_sync(pool):
+        return
+    versions = dict(db.session.query(Resource.id, Resource.version).filter_by(pool=pool).all())
+    stale = index.set_pool(pool, versions)
+    if stale:
+        load_timelines(index, {rid: versions[rid] for rid in stale})
+    index.prune(now_pst().replace(tzinfo=None))
+
+def allocate_from_pool(pool, start, end):
+    """Picks and locks the best-fit free member of `pool` for [start, end).
+
+    Returns ((resource_id, version), None), or (None, error) when no member
+    can take the booking. `error` is the message of a member's own rules when
+    free members were passed over only because their per-resource rules
+    refuse the booking, and None when none is free. Only the chosen member is
+    checked against the database: its locked version must match the index,
+    otherwise that timeline is reloaded and the choice redone. Before reporting
+    "none free", the whole pool is re-synced once so a stale index cannot
+    cause a false rejection.
+    """
+    index = schedule_index()
+    sync_pool(index, pool)
+    resynced = False
+    refused, rule_error = 0, None
+    attempts = 0
+    while attempts < POOL_ALLOCATION_ATTEMPTS:
+        resource_id = index.best_fit(pool, start, end, exclude=refused)
+        if resource_id is None:
+            if resynced:
+                return None, rule_error
+            sync_pool(index, pool, force=True)
+            resynced = True
+            continue
+        # The pool's rules were checked up front; a member may override them.
+        error = booking_rules(resource_id).check(localize(start), localize(end), now_pst())
+        if error:
+            refused |= 1 << resource_id
+            rule_error = rule_error or error
+            continue
+        attempts += 1
+        version = lock_resource(resource_id)
+        if version == index.version(resource_id):
+            return (resource_id, version), None
+        load_timelines(index, {resource_id: version})
+    return None, None
+
+def decode_body(schema):
+    """Decodes the JSON request body with a compiled `schema` (see schemas.py).
+
+    Returns (body, None), or (None, error response). Werkzeug enforces
+    MAX_CONTENT_LENGTH while the body is read, so an oversized one is refused
+    from its Content-Length alone, or as soon as a chunked one passes the cap.
+    """
+    if not request.is_json:
+        return None, (jsonify({"error": "Expected a JSON body (Content-Type: application/json)"}), 415)
+    try:
+        return schema.decode(request.get_data(cache=False)), None
+    except RequestEntityTooLarge:
+        limit = current_app.config['MAX_CONTENT_LENGTH']
+        return None, (jsonify({"error": f"Request body is larger than {limit} bytes"}), 413)
+    except SchemaError as e:
+        return None, (jsonify({"error": str(e)}), 400)
+
+def wants_msgpack():
+    """Whether the request's Accept header prefers MessagePack to JSON."""
+    return request.accept_mimetypes.best_match(['application/json', MSGPACK]) == MSGPACK
+
+def negotiated(build_json, build_packed, status):
+    """A response in the format the client accepts; each builder makes one body.
+
+    JSON is the default. Errors are always JSON, so clients tell formats apart
+    by Content-Type.
+    """
+    if wants_msgpack():
+        response = current_app.response_class(msgpack.packb(build_packed()), mimetype=MSGPACK)
+    else:
+        response = jsonify(build_json())
+    response.vary.add('Accept')
+    return response, status
+
+def send_cached(entry, status=200, vary=()):
+    """Response for a CachedBody, using its stored variant for the client's encoding."""
+    encoding = None
+    if len(entry.body) >= current_app.config['COMPRESS_MIN_BYTES']:
+        encoding = choose_encoding(request.accept_encodings)
+    response = current_app.response_class(entry.variant(encoding) if encoding else entry.body,
+                                          status=status, mimetype=entry.mimetype)
+    if encoding:
+        response.headers['Content-Encoding'] = encoding
+    response.vary.update(vary)
+    response.vary.add('Accept-Encoding')
+    return response
+
+@bp.after_app_request
+def compress_response(response):
+    """Compresses a response body for clients that accept gzip or brotli.
+
+    Bodies sent by send_cached() are already encoded, and streamed or file
+    responses are left alone.
+    """
+    if (response.direct_passthrough or response.is_streamed or 'Content-Encoding' in response.headers
+            or not compressible(response.mimetype)):
+        return response
+    response.vary.add('Accept-Encoding')
+    body = response.get_data()
+    if len(body) < current_app.config['COMPRESS_MIN_BYTES']:
+        return response
+    encoding = choose_encoding(request.accept_encodings)
+    if encoding is not None:
+        response.set_data(compress(body, encoding))
+        response.headers['Content-Encoding'] = encoding
+    return response
+
+def response_cache():
+    return current_app.extensions['response_cache']
+
+def data_version(resource_id=None):
+    """A number that moves whenever a reservation is written.
+
+    For one resource that is its own version, so writes elsewhere leave its
+    cached listings alone; otherwise it is the sum over all resources.
+    """
+    if resource_id is not None:
+        return db.session.query(Resource.version).filter_by(id=resource_id).scalar()
+    return db.session.query(func.coalesce(func.sum(Resource.version), 0)).scalar()
+
+def reservation_response(reservation, status):
+    """One reservation: a JSON object, or a MessagePack map of PACKED_FIELDS."""
+    return negotiated(reservation.to_dict, lambda: dict(zip(PACKED_FIELDS, reservation.to_packed())), status)
+
+def reservation_list_response(reservations):
+    """Reservations: a JSON array of objects, or a MessagePack map of columns.
+
+    The columnar form sends each field name once and each time as an integer:
+    {"id": [...], "resource_id": [...], "username": [...], ...}.
+    """
+    def columns():
+        rows = [r.to_packed() for r in reservations]
+        return {field: [row[i] for row in rows] for i, field in enumerate(PACKED_FIELDS)}
+    return negotiated(lambda: [r.to_dict() for r in reservations], columns, 200)
+
+@bp.route('/reservations', methods=['POST'])
 def create_reservation():
-    data = request.get_json()
-    if not data:
-        return jsonify({"error": "Invalid input"}), 400
+    booking, error = decode_body(BOOKING)
+    if error:
+        return error
+    return place_booking(booking)
 
-    username = data.get('username')
-    start_time_str = data.get('start_time')
-    end_time_str = data.get('end_time')
+@bp.route('/reservations/hold', methods=['POST'])
+def create_hold():
+    """First phase of a two-phase booking: claims the interval for `ttl_seconds`.
 
-    if not all([username, start_time_str, end_time_str]):
-        return jsonify({"error": "Missing required fields"}), 400
+    The hold is a reservation row with a deadline. Conflict checks see it like
+    any booking until it is confirmed, released or expires.
+    """
+    hold, error = decode_body(HOLD)
+    if error:
+        return error
+    ttl = hold.ttl_seconds
+    if ttl is None:
+        ttl = current_app.config['HOLD_DEFAULT_SECONDS']
+    max_ttl = current_app.config['HOLD_MAX_SECONDS']
+    if not 1 <= ttl <= max_ttl:
+        return jsonify({"error": f"ttl_seconds must be between 1 and {max_ttl}"}), 400
+    return place_booking(hold, hold_seconds=ttl)
+
+def owned_hold(reservation_id):
+    """The hold `reservation_id` if the request body names its user, else an error response."""
+    owner, error = decode_body(OWNER)
+    if error:
+        return None, error
+    hold = db.session.get(Reservation, reservation_id)
+    if hold is None or hold.hold_expires_at is None:
+        return None, (jsonify({"error": "No such hold"}), 404)
+    if owner.username != hold.user.name:
+        return None, (jsonify({"error": "Only the user who placed a hold can confirm or release it"}), 403)
+    return hold, None
+
+@bp.route('/reservations/<int:reservation_id>/confirm', methods=['POST'])
+def confirm_hold(reservation_id):
+    """Second phase: turns an unexpired hold into a booking."""
+    begin_booking()
+    hold, error = owned_hold(reservation_id)
+    if error:
+        return error
+    if hold.hold_expires_at <= now_utc():
+        return jsonify({"error": "Hold has expired"}), 410
+    # The interval, summaries and ledger were all updated when the hold was
+    # placed; the version still moves, since listings show the hold deadline.
+    hold.hold_expires_at = None
+    version = bump_version(hold.resource_id, lock_resource(hold.resource_id))
+    db.session.commit()
+    schedule_index().touch(hold.resource_id, version)
+    hold_wheel().cancel(reservation_id)
+    return jsonify(hold.to_dict()), 200
+
+@bp.route('/reservations/<int:reservation_id>/hold', methods=['DELETE'])
+def release_hold(reservation_id):
+    """Gives a hold up before it expires."""
+    begin_booking()
+    hold, error = owned_hold(reservation_id)
+    if error:
+        return error
+    cancel_reservation(hold)
+    hold_wheel().cancel(reservation_id)
+    return jsonify({"released": reservation_id}), 200
+
+def parse_interval(start_str, end_str):
+    """Parses a request's naive PST start and end times into aware datetimes.
 
+    Returns ((start, end), None), or ((None, None), error response).
+    """
     try:
         # Parse naive date/time string. Backend assumes it's in PST.
         # Then localize it to make it timezone-aware.
-        naive_start_time = parser.isoparse(start_time_str)
-        naive_end_time = parser.isoparse(end_time_str)
+        return (localize(parse_local(start_str)), localize(parse_local(end_str))), None
+    except NonExistentTimeError as e:
+        return (None, None), (jsonify({"error": f"{e} (skipped by the daylight saving change)"}), 400)
+    except AmbiguousTimeError as e:
+        return (None, None), (jsonify({"error": f"{e} (occurs twice during the daylight saving change)"}), 400)
+    except ValueError:
+        return (None, None), (jsonify({"error": "Invalid date format. Use YYYY-MM-DD HH:MM"}), 400)
 
-        start_time = PST.localize(naive_start_time)
-        end_time = PST.localize(naive_end_time)
+def check_interval(start_time, end_time, now, rules):
+    """Error response if [start_time, end_time) breaks the booking `rules`, else None."""
+    error = rules.check(start_time, end_time, now)
+    return (jsonify({"error": error}), 400) if error else None
 
-    except ValueError:
-        return jsonify({"error": "Invalid date format. Use YYYY-MM-DD HH:MM"}), 400
+def owned_reservation(reservation_id, username):
+    """The booking `reservation_id` if `username` made it, else an error response."""
+    reservation = db.session.get(Reservation, reservation_id)
+    if reservation is None or reservation.blackout_id is not None:
+        return None, (jsonify({"error": "No such reservation"}), 404)
+    if username != reservation.user.name:
+        return None, (jsonify({"error": "Only the user who made a reservation can change it"}), 403)
+    return reservation, None
+
+@bp.route('/reservations/<int:reservation_id>', methods=['DELETE'])
+def delete_reservation(reservation_id):
+    """Cancels a reservation (or hold) that has not started yet.
+
+    The interval is free to others as soon as this returns; waitlisted requests
+    that now fit are booked in the same transaction.
+    """
+    owner, error = decode_body(OWNER)
+    if error:
+        return error
+    begin_booking()
+    reservation, error = owned_reservation(reservation_id, owner.username)
+    if error:
+        return error
+    if reservation.start_time <= now_pst().replace(tzinfo=None):
+        return jsonify({"error": "Reservation has already started; end it instead"}), 409
+    cancel_reservation(reservation)
+    hold_wheel().cancel(reservation_id)
+    return jsonify({"cancelled": reservation_id}), 200
+
+@bp.route('/reservations/<int:reservation_id>/end', methods=['POST'])
+def end_reservation(reservation_id):
+    """Ends an active reservation now, releasing the rest of its interval."""
+    owner, error = decode_body(OWNER)
+    if error:
+        return error
+    begin_booking()
+    reservation, error = owned_reservation(reservation_id, owner.username)
+    if error:
+        return error
+    now = now_pst().replace(tzinfo=None, microsecond=0)
+    if not reservation.start_time < now < reservation.end_time or reservation.hold_expires_at is not None:
+        return jsonify({"error": "Only a confirmed reservation in progress can be ended"}), 409
+    lock_user(reservation.user_id)
+    version = lock_resource(reservation.resource_id)
+    resource_id, start, end = reservation.resource_id, reservation.start_time, reservation.end_time
+    version = resize_reservation(reservation, start, now, version)
+    promoted = promote_waiters(resource_id, now, end)
+    db.session.commit()
+    schedule_index().move(resource_id, start, end, start, now, version)
+    for booked in promoted:
+        apply_booking(*booked)
+    return jsonify(reservation.to_dict()), 200
+
+def interval_difference(start, end, other_start, other_end):
+    """The parts of [start, end) outside [other_start, other_end), in order."""
+    if other_end <= start or other_start >= end:
+        return [(start, end)]
+    parts = []
+    if start < other_start:
+        parts.append((start, other_start))
+    if other_end < end:
+        parts.append((other_end, end))
+    return parts
+
+@bp.route('/reservations/<int:reservation_id>', methods=['PATCH'])
+def modify_reservation(reservation_id):
+    """Moves, extends or shortens a reservation in place.
+
+    Takes `start_time` and/or `end_time`. Once a reservation has started only
+    its end can change. Only the time being added is checked for conflicts,
+    and the reservation itself is never one of them. Freed time goes to the
+    waitlist as for a cancellation.
+    """
+    change, error = decode_body(CHANGE)
+    if error:
+        return error
+    if not (change.start_time or change.end_time):
+        return jsonify({"error": "Give a new start_time and/or end_time"}), 400
+    begin_booking()
+    reservation, error = owned_reservation(reservation_id, change.username)
+    if error:
+        return error
+    old_start, old_end = reservation.start_time, reservation.end_time
+    (start_time, end_time), error = parse_interval(change.start_time or old_start.strftime('%Y-%m-%d %H:%M:%S'),
+                                                   change.end_time or old_end.strftime('%Y-%m-%d %H:%M:%S'))
+    if error:
+        return error
+    start, end = start_time.replace(tzinfo=None), end_time.replace(tzinfo=None)
+
+    now = now_pst()
+    now_wall = now.replace(tzinfo=None)
+    if old_end <= now_wall:
+        return jsonify({"error": "Reservation has already ended"}), 409
+    if start != old_start and (old_start <= now_wall or start <= now_wall):
+        return jsonify({"error": "Only the end of a reservation in progress can change, and a new start must be in the future"}), 409
+    if end <= now_wall:
+        return jsonify({"error": "End time must be in the future; end the reservation instead"}), 400
+    error = check_interval(start_time, end_time, now, booking_rules(reservation.resource_id))
+    if error:
+        return error
 
-    now_pst = datetime.now(PST)
+    lock_user(reservation.user_id)
+    resource_id = reservation.resource_id
+    version = lock_resource(resource_id)
+    for part_start, part_end in interval_difference(start, end, old_start, old_end):
+        if any(r.id != reservation_id for r in find_nearby(resource_id, part_start, part_end)):
+            nearby = [r for r in find_nearby(resource_id, start, end, CONFLICT_SEARCH_WINDOW) if r.id != reservation_id]
+            return jsonify(conflict_details(resource_id, nearby, start, end, now_wall,
+                                            booking_rules(resource_id).cutoff(now_wall))), 409
+    quota_error = check_quota(reservation.user_id, start, end, now_wall, replacing=reservation)
+    if quota_error:
+        return jsonify({"error": quota_error}), 403
+
+    version = resize_reservation(reservation, start, end, version)
+    promoted = []
+    for part_start, part_end in interval_difference(old_start, old_end, start, end):
+        promoted += promote_waiters(resource_id, part_start, part_end)
+    db.session.commit()
+    schedule_index().move(resource_id, old_start, old_end, start, end, version)
+    for booked in promoted:
+        apply_booking(*booked)
+    return jsonify(reservation.to_dict()), 200
+
+def priority_allowed():
+    """Whether the request carries the configured PRIORITY_TOKEN.
+
+    A priority booking can move or cancel other users' bookings, and usernames
+    are not authenticated, so the body alone never grants one.
+    """
+    token = current_app.config['PRIORITY_TOKEN']
+    sent = request.headers.get('X-Priority-Token')
+    return bool(token) and sent is not None and hmac.compare_digest(sent.encode(), token.encode())
+
+def place_booking(booking, hold_seconds=None):
+    """Validates and books a decoded BOOKING or HOLD body; with hold_seconds, places a hold instead.
+
+    Field presence and types were checked by the schema; this checks values.
+    """
+    username = booking.username
+    if username == BLACKOUT_USERNAME:
+        return jsonify({"error": f"The username {BLACKOUT_USERNAME!r} is reserved for blackouts"}), 400
+
+    resource_id = booking.resource_id
+    pool = booking.pool
+    if pool is not None:
+        if resource_id is not None:
+            return jsonify({"error": "Specify either resource_id or pool, not both"}), 400
+        if Resource.query.filter_by(pool=pool).first() is None:
+            return jsonify({"error": "Unknown resource pool"}), 400
+    elif resource_id is None:
+        resource_id = default_resource_id()
+    elif db.session.get(Resource, resource_id) is None:
+        return jsonify({"error": "Unknown resource"}), 400
+
+    priority = booking.priority
+    if not 0 <= priority <= MAX_PRIORITY:
+        return jsonify({"error": f"priority must be an integer between 0 and {MAX_PRIORITY}"}), 400
+    if priority and not priority_allowed():
+        return jsonify({"error": "Priority bookings need a valid X-Priority-Token header"}), 403
+    if priority and pool is not None:
+        return jsonify({"error": "Priority bookings must name a resource"}), 400
+
+    wants_waitlist = booking.waitlist
+    if wants_waitlist and (pool is not None or hold_seconds is not None):
+        return jsonify({"error": "Only direct bookings of a resource can join a waitlist"}), 400
+
+    (start_time, end_time), error = parse_interval(booking.start_time, booking.end_time)
+    if error:
+        return error
+
+    now = now_pst()
 
     # Validate: Start time must be in the future
-    if start_time <= now_pst:
+    if start_time <= now:
         return jsonify({"error": "Reservations can only be made for future dates/times"}), 400
 
-    # Validate: End time must be after start time
-    if end_time <= start_time:
-        return jsonify({"error": "End time must be after start time"}), 400
+    error = check_interval(start_time, end_time, now, booking_rules(resource_id, pool))
+    if error:
+        return error
 
-    # Validate: Minimum reservation duration
-    if (end_time - start_time) < MIN_RESERVATION_DURATION:
-        return jsonify({"error": f"Minimum reservation duration is {MIN_RESERVATION_DURATION.total_seconds() / 60} minutes"}), 400
-
-    # Validate: Maximum reservation duration
-    if (end_time - start_time) > MAX_RESERVATION_DURATION:
-        return jsonify({"error": f"Maximum reservation duration is {MAX_RESERVATION_DURATION.total_seconds() / 3600} hours"}), 400
-
-    # Validate: Advance booking limit
-    # Reservations can be made up to ADVANCE_BOOKING_LIMIT days in the future.
-    # This means if today is Day 0, the latest reservable day is Day 30.
-    # The start_time must be before the beginning of Day 31.
-    limit_cutoff_datetime = (now_pst.replace(hour=0, minute=0, second=0, microsecond=0) +
-                             ADVANCE_BOOKING_LIMIT +
-                             timedelta(days=1))
-
-    if start_time >= limit_cutoff_datetime:
-        # To display a user-friendly "last allowed day"
-        last_allowed_day = limit_cutoff_datetime - timedelta(days=1)
-        return jsonify({
-            "error": f"Reservations can only be made up to {ADVANCE_BOOKING_LIMIT.days} days in advance (last available day is {last_allowed_day.strftime('%Y-%m-%d')})"
-        }), 400
-
-    # Validate: No overlapping reservations
-    # Query needs to handle timezone-aware datetime objects correctly.
-    # SQLAlchemy typically converts aware datetimes to UTC for storage in SQLite if not configured otherwise,
-    # or stores them as is if the column type supports it (which DateTime does by default with SQLite).
-    # Let's assume they are stored as timezone-aware (or converted to a consistent TZ like UTC).
-    # For filtering, ensure comparison values are also timezone-aware.
-    overlapping_reservations = Reservation.query.filter(
-        (Reservation.start_time < end_time) & (Reservation.end_time > start_time)
+    start_wall, end_wall = start_time.replace(tzinfo=None), end_time.replace(tzinfo=None)
+    now_wall = now.replace(tzinfo=None)
+    round_day = opening_round_day(start_wall, now_wall)
+    if round_day is not None:
+        return join_opening_round(round_day, username, resource_id, pool, start_wall, end_wall, hold_seconds, priority)
+
+    # Validate: No overlapping reservations on the same resource
+    begin_booking()
+    user_id = intern_user(username)
+    booked, error = try_booking(user_id, resource_id, pool, start_wall, end_wall, now_wall, hold_seconds, priority)
+    if error and wants_waitlist and error[1] == 409:
+        entry = WaitlistEntry(resource_id=resource_id, user_id=user_id, start_time=start_wall, end_time=end_wall)
+        db.session.add(entry)
+        db.session.commit()
+        return jsonify(dict(error[0], waitlist=entry.to_dict())), 202
+    db.session.commit()
+    if error:
+        body, status = error
+        return jsonify(body), status
+    apply_booking(*booked)
+    return reservation_response(booked[0], 201)
+
+def try_booking(user_id, resource_id, pool, start, end, now, hold_seconds=None, priority=0):
+    """Checks and inserts one booking in the current booking transaction.
+
+    `start`, `end` and `now` are naive PST wall-clock times. Nothing is
+    committed. Returns ((reservation, version), None) on success, or
+    (None, (body, status)) when a quota or a conflict rejects the booking. A
+    409 also adds its BookingRejection row. After the commit, pass the success
+    tuple to apply_booking(). With a priority, conflicting bookings may be
+    displaced instead (see preempt()). Expired holds in the way are released
+    (see release_expired_holds()).
+    """
+    lock_user(user_id)
+    quota_error = check_quota(user_id, start, end, now)
+    if quota_error:
+        return None, ({"error": quota_error}, 403)
+    if pool is not None:
+        allocation, rule_error = allocate_from_pool(pool, start, end)
+        if rule_error and allocation is None:
+            return None, ({"error": rule_error}, 400)
+        if allocation is None:
+            record_rejection(start, end, pool=pool)
+            return None, ({"error": "No resource in the pool is free for the requested time slot"}, 409)
+        resource_id, version = allocation
+        version = release_expired_holds(resource_id, start, end, version)
+    else:
+        version = lock_resource(resource_id)
+        version = release_expired_holds(resource_id, start, end, version)
+        blockers = find_nearby(resource_id, start, end)
+        if blockers and displaceable(blockers, now, priority):
+            version = preempt(resource_id, blockers, start, end, now, version)
+        elif blockers:
+            # Rare path: widen the same range scan to find alternatives for the client.
+            nearby = find_nearby(resource_id, start, end, CONFLICT_SEARCH_WINDOW)
+            body = conflict_details(resource_id, nearby, start, end, now, booking_rules(resource_id).cutoff(now))
+            record_rejection(start, end, resource_id=resource_id)
+            return None, (body, 409)
+
+    reservation = Reservation(resource_id=resource_id, user_id=user_id, start_time=start, end_time=end,
+                              priority=priority)
+    if hold_seconds is not None:
+        reservation.hold_expires_at = now_utc() + timedelta(seconds=hold_seconds)
+    db.session.add(reservation)
+    summarize(resource_id, start, end)
+    charge_usage(user_id, start, end)
+    version = bump_version(resource_id, version)
+    db.session.flush()
+    return (reservation, version), None
+
+def release_expired_holds(resource_id, start, end, version):
+    """Deletes expired holds overlapping [start, end) on the locked resource; returns the new version.
+
+    in_force() already ignores them, but until the sweeper reaches them they
+    are still counted in the summaries and their owner's ledger. Releasing
+    them here keeps a booking and the hold it replaces from being counted
+    together. An owner busy booking elsewhere is skipped and left to the
+    sweeper, as in displaceable().
+    """
+    expired = Reservation.query.filter(
+        Reservation.resource_id == resource_id,
+        Reservation.start_time > start - MAX_RESERVATION_DURATION,
+        Reservation.start_time < end,
+        Reservation.end_time > start,
+        Reservation.hold_expires_at <= now_utc(),
     ).all()
+    for hold in expired:
+        if lock_user(hold.user_id, skip_locked=True):
+            version = remove_reservation(hold, version)
+    return version
+
+def displaceable(blockers, now, priority):
+    """Whether a booking at `priority` may displace all of `blockers`.
+
+    Only bookings of lower priority that have not started qualify, never
+    blackouts, and at most PREEMPT_MAX_DISPLACED of them. Their owners are
+    locked with skip_locked (the resource is already locked), so an owner busy
+    booking elsewhere makes the request a plain conflict instead of a wait.
+    """
+    if not priority or len(blockers) > current_app.config['PREEMPT_MAX_DISPLACED']:
+        return False
+    if any(r.priority >= priority or r.blackout_id is not None or r.start_time <= now for r in blockers):
+        return False
+    return all(lock_user(r.user_id, skip_locked=True) for r in blockers)
+
+def preempt(resource_id, displaced, start, end, now, version):
+    """Clears [start, end) for a priority booking; returns the new resource version.
+
+    Each displaced booking moves in place to the nearest free window of the same
+    length on the same resource (see nearest_windows()), or is cancelled if
+    there is none within CONFLICT_SEARCH_WINDOW. Its owner gets a notification.
+    Everything happens in the caller's booking transaction.
+    """
+    cutoff = booking_rules(resource_id).cutoff(now)
+    pending = {r.id for r in displaced}
+    for reservation in displaced:
+        pending.discard(reservation.id)
+        old_start, old_end = reservation.start_time, reservation.end_time
+        busy = Timeline([(r.start_time, r.end_time) for r in find_nearby(
+            resource_id, old_start, old_end, CONFLICT_SEARCH_WINDOW)
+            if r.id != reservation.id and r.id not in pending] + [(start, end)])
+        windows = [w for w in nearest_windows(busy, old_start, old_end, now, cutoff) if w]
+        if windows:
+            new_start, new_end = min(windows, key=lambda w: abs(w[0] - old_start))
+            version = resize_reservation(reservation, new_start, new_end, version)
+            message = (f"Your reservation {reservation.id} from {format_local(old_start)} was moved to "
+                       f"{format_local(new_start)} - {format_local(new_end)} for a priority booking")
+        else:
+            message = (f"Your reservation {reservation.id} from {format_local(old_start)} was cancelled "
+                       f"for a priority booking; no nearby slot was free")
+            version = remove_reservation(reservation, version)
+        db.session.add(Notification(user_id=reservation.user_id, reservation_id=reservation.id,
+                                    created_at=now_utc(), message=message))
+    return version
+
+def apply_booking(reservation, version):
+    """Mirrors a committed booking into the schedule index and, for holds, the timing wheel."""
+    schedule_index().record(reservation.resource_id, reservation.start_time, reservation.end_time, version)
+    if reservation.hold_expires_at is not None:
+        hold_wheel().schedule(reservation.id, hold_deadline(reservation.hold_expires_at))
+
+class RoundEntry(db.Model):
+    """One booking request for a newly opened day, queued during its opening round.
+
+    The queue lives in the database, so requests that reach different workers
+    take part in the same round.
+    """
+    __tablename__ = 'round_entry'
+    __table_args__ = (
+        db.Index('ix_round_entry_day_status', 'day', 'status'),
+    )
+
+    id = db.Column(db.Integer, primary_key=True)
+    day = db.Column(db.Date, nullable=False)
+    user_id = db.Column(db.Integer, db.ForeignKey('user.id'), nullable=False)
+    resource_id = db.Column(db.Integer, db.ForeignKey('resource.id'), nullable=True)
+    pool = db.Column(db.String(80), nullable=True)
+    start_time = db.Column(db.DateTime, nullable=False)
+    end_time = db.Column(db.DateTime, nullable=False)
+    hold_seconds = db.Column(db.Integer, nullable=True)
+    priority = db.Column(db.Integer, nullable=False, default=0)
+    # 'pending' until the round runs, then 'booked' or 'rejected'.
+    status = db.Column(db.String(16), nullable=False, default='pending')
+    # The HTTP status and JSON body returned to the client once decided.
+    status_code = db.Column(db.Integer, nullable=True)
+    response = db.Column(db.Text, nullable=True)
+
+def opening_round_end(now):
+    """End of today's opening round as a naive wall-clock time, or None if disabled."""
+    seconds = current_app.config['OPENING_ROUND_SECONDS']
+    if not seconds:
+        return None
+    return now.replace(hour=0, minute=0, second=0, microsecond=0) + timedelta(seconds=seconds)
+
+def opening_round_day(start, now):
+    """The day that opened at midnight if `start` falls on it and its round is still open.
+
+    Bookings for any other day, or made after the round, go straight through.
+    """
+    round_end = opening_round_end(now)
+    if round_end is None or now >= round_end:
+        return None
+    day = (advance_booking_cutoff(now) - timedelta(days=1)).date()
+    return day if start.date() == day else None
+
+def join_opening_round(day, username, resource_id, pool, start, end, hold_seconds, priority=0):
+    """Queues a request for `day`'s opening round and answers 202 with where to find its outcome.
+
+    Arrival order within the round doesn't matter. The request thread is not
+    held until the round closes: the round is run by a timer in this worker
+    (see schedule_opening_round()), or by the first status poll after it
+    closes, whichever comes first.
+    """
+    entry = RoundEntry(day=day, user_id=intern_user(username), resource_id=resource_id, pool=pool,
+                       start_time=start, end_time=end, hold_seconds=hold_seconds, priority=priority)
+    db.session.add(entry)
+    db.session.commit()
+
+    now = now_pst().replace(tzinfo=None)
+    round_end = opening_round_end(now)
+    if not current_app.testing:
+        schedule_opening_round(current_app._get_current_object(), day, (round_end - now).total_seconds())
+    return round_pending_response(entry, round_end, now)
+
+def round_pending_response(entry, round_end, now):
+    """202 for an undecided RoundEntry, with its status URL and when to ask again."""
+    status_url = url_for('reservations.get_round_entry', entry_id=entry.id)
+    response = jsonify({"opening_round": {"id": entry.id, "status": entry.status,
+                                          "decided_after": format_local(round_end), "status_url": status_url}})
+    response.status_code = 202
+    response.headers['Location'] = status_url
+    response.headers['Retry-After'] = str(max(1, math.ceil((round_end - now).total_seconds())))
+    return response
+
+def schedule_opening_round(app, day, delay):
+    """Runs `day`'s opening round on a daemon timer once it closes, once per worker.
 
-    if overlapping_reservations:
-        return jsonify({"error": "Requested time slot is already reserved or overlaps with an existing reservation"}), 409
+    Another worker's timer or a status poll may run it first; run_opening_round()
+    then finds nothing pending.
+    """
+    scheduled = app.extensions['opening_rounds']
+    if day in scheduled:
+        return
+    scheduled.add(day)
 
-    new_reservation = Reservation(username=username, start_time=start_time, end_time=end_time)
-    db.session.add(new_reservation)
+    def run():
+        with app.app_context():
+            try:
+                run_opening_round(day, app.config['OPENING_ROUND_POLICY'])
+            except Exception:
+                app.logger.exception('Opening round for %s failed', day)
+            finally:
+                db.session.remove()
+                scheduled.discard(day)
+
+    timer = threading.Timer(max(delay, 0), run)
+    timer.daemon = True
+    timer.start()
+
+@bp.route('/opening-round/<int:entry_id>', methods=['GET'])
+def get_round_entry(entry_id):
+    """Outcome of a queued opening-round request: its 201/403/409, or 202 while the round is open."""
+    entry = db.session.get(RoundEntry, entry_id)
+    if entry is None:
+        return jsonify({"error": "No such opening-round request"}), 404
+    if entry.status == 'pending':
+        now = now_pst().replace(tzinfo=None)
+        if opening_round_day(entry.start_time, now) == entry.day:
+            return round_pending_response(entry, opening_round_end(now), now)
+        run_opening_round(entry.day, current_app.config['OPENING_ROUND_POLICY'])
+        entry = db.session.get(RoundEntry, entry_id)
+    return current_app.response_class(entry.response, status=entry.status_code, mimetype='application/json')
+
+def fair_order(entries, policy, rng):
+    """Order in which an opening round books `entries`; arrival order is ignored.
+
+    'lottery' shuffles all requests. 'round_robin' shuffles the users, then
+    takes every user's first request, then every user's second, and so on, so
+    sending more requests never buys an earlier turn.
+    """
+    if policy == 'lottery':
+        ordered = list(entries)
+        rng.shuffle(ordered)
+        return ordered
+    by_user = {}
+    for entry in entries:
+        by_user.setdefault(entry.user_id, []).append(entry)
+    users = list(by_user)
+    rng.shuffle(users)
+    ordered = []
+    for turn in range(max(map(len, by_user.values()), default=0)):
+        ordered.extend(by_user[user][turn] for user in users if turn < len(by_user[user]))
+    return ordered
+
+def run_opening_round(day, policy, rng=None):
+    """Books every pending entry of `day`'s opening round in fair_order().
+
+    Runs in one booking transaction. All users are locked up front in id order,
+    then all named resources, which keeps the user-then-resource lock order
+    that single bookings use. Returns the number of entries decided.
+    """
+    begin_booking()
+    query = RoundEntry.query.filter_by(day=day, status='pending').order_by(RoundEntry.id)
+    if db.engine.dialect.name != 'sqlite':
+        query = query.with_for_update()
+    entries = query.all()
+    if not entries:
+        db.session.commit()
+        return 0
+    for user_id in sorted({e.user_id for e in entries}):
+        lock_user(user_id)
+    for resource_id in sorted({e.resource_id for e in entries if e.resource_id is not None}):
+        lock_resource(resource_id)
+
+    now = now_pst().replace(tzinfo=None)
+    booked = []
+    for entry in fair_order(entries, policy, rng or random.Random()):
+        result, error = try_booking(entry.user_id, entry.resource_id, entry.pool,
+                                    entry.start_time, entry.end_time, now, entry.hold_seconds, entry.priority)
+        if error:
+            body, entry.status_code = error
+            entry.status = 'rejected'
+        else:
+            booked.append(result)
+            body, entry.status_code = result[0].to_dict(), 201
+            entry.status = 'booked'
+        entry.response = json.dumps(body)
     db.session.commit()
+    for result in booked:
+        apply_booking(*result)
+    return len(entries)
+
+@bp.route('/users/<username>/waitlist', methods=['GET'])
+def get_user_waitlist(username):
+    """Waitlist entries of one user that can still be promoted."""
+    now = now_pst().replace(tzinfo=None)
+    user_id = db.session.query(User.id).filter_by(name=username).scalar()
+    if user_id is None:
+        return jsonify([]), 200
+    entries = WaitlistEntry.query.filter(
+        WaitlistEntry.user_id == user_id,
+        WaitlistEntry.start_time > now,
+    ).order_by(WaitlistEntry.start_time).all()
+    return jsonify([e.to_dict() for e in entries]), 200
 
-    return jsonify(new_reservation.to_dict()), 201
+@bp.route('/users/<username>/notifications', methods=['GET'])
+def get_user_notifications(username):
+    """A user's most recent notifications, newest first."""
+    user_id = db.session.query(User.id).filter_by(name=username).scalar()
+    if user_id is None:
+        return jsonify([]), 200
+    notifications = Notification.query.filter_by(user_id=user_id).order_by(
+        Notification.created_at.desc(), Notification.id.desc()).limit(HISTORY_DEFAULT_LIMIT)
+    return jsonify([n.to_dict() for n in notifications]), 200
 
-@app.route('/reservations', methods=['GET'])
+@bp.route('/waitlist/<int:entry_id>', methods=['DELETE'])
+def leave_waitlist(entry_id):
+    """Withdraws a waitlist entry; the body names its user, as for holds."""
+    owner, error = decode_body(OWNER)
+    if error:
+        return error
+    entry = db.session.get(WaitlistEntry, entry_id)
+    if entry is None:
+        return jsonify({"error": "No such waitlist entry"}), 404
+    if owner.username != entry.user.name:
+        return jsonify({"error": "Only the user who joined a waitlist can leave it"}), 403
+    db.session.delete(entry)
+    db.session.commit()
+    return jsonify({"left": entry_id}), 200
+
+@bp.route('/reservations', methods=['GET'])
 def get_reservations():
-    view = request.args.get('view', 'all') # 'all', 'day', 'week'
-    now_pst = datetime.now(PST)
+    view = request.args.get('view', 'all') # 'all', 'day', 'week', 'history'
+    now = now_pst()
 
-    # Base query: only future/active reservations, ordered by start time
-    query = Reservation.query.filter(Reservation.end_time > now_pst)
+    if view == 'history':
+        return get_history(now.replace(tzinfo=None))
 
+    resource_id = request.args.get('resource_id', type=int)
+    window = None
     if view == 'day':
         # Today in PST
-        today_start_pst = now_pst.replace(hour=0, minute=0, second=0, microsecond=0)
-        today_end_pst = today_start_pst + timedelta(days=1)
-        query = query.filter(Reservation.start_time >= today_start_pst, Reservation.start_time < today_end_pst)
+        today_start_pst = now.replace(hour=0, minute=0, second=0, microsecond=0)
+        window = (today_start_pst, today_start_pst + timedelta(days=1))
     elif view == 'week':
         # Current week in PST, starting Monday
-        start_of_week_pst = (now_pst - timedelta(days=now_pst.weekday())).replace(hour=0, minute=0, second=0, microsecond=0)
-        end_of_week_pst = start_of_week_pst + timedelta(weeks=1)
-        query = query.filter(Reservation.start_time >= start_of_week_pst, Reservation.start_time < end_of_week_pst)
+        start_of_week_pst = (now - timedelta(days=now.weekday())).replace(hour=0, minute=0, second=0, microsecond=0)
+        window = (start_of_week_pst, start_of_week_pst + timedelta(weeks=1))
+
+    # A listing changes only when a reservation is written, which moves the
+    # data version (read before the rows, so an entry is never older than its
+    # key), when one of its reservations ends, or when one of its holds
+    # expires. It is cached until then.
+    key = ('reservations', window, resource_id, wants_msgpack(), data_version(resource_id))
+    now_wall = now.replace(tzinfo=None)
+    entry = response_cache().get(key, now_wall)
+    if entry is None:
+        # Base query: only future/active reservations, ordered by start time
+        query = Reservation.query.filter(Reservation.end_time > now, in_force())
+        if resource_id is not None:
+            query = query.filter(Reservation.resource_id == resource_id)
+        if window is not None:
+            query = query.filter(Reservation.start_time >= window[0], Reservation.start_time < window[1])
+        reservations = query.order_by(Reservation.start_time).all()
+        response, _ = reservation_list_response(reservations)
+        changes = [r.end_time for r in reservations] + [
+            r.hold_expires_at + utc_offset(r.hold_expires_at) for r in reservations if r.hold_expires_at is not None]
+        entry = response_cache().put(key, CachedBody(response.get_data(), response.mimetype,
+                                                     min(changes, default=None)))
+    return send_cached(entry, vary=('Accept',))
+
+@bp.route('/users/<username>/reservations', methods=['GET'])
+def get_user_reservations(username):
+    """Upcoming and active reservations of one user, read from the (user_id, start_time) index."""
+    now = now_pst().replace(tzinfo=None)
+    user_id = db.session.query(User.id).filter_by(name=username).scalar()
+    if user_id is None:
+        return jsonify([]), 200
+    reservations = Reservation.query.filter(
+        Reservation.user_id == user_id,
+        Reservation.start_time > now - MAX_RESERVATION_DURATION,
+        Reservation.end_time > now,
+        in_force(),
+    ).order_by(Reservation.start_time).all()
+    return reservation_list_response(reservations)
+
+def get_history(now):
+    """Ended reservations, newest first, from the hot table and the archive.
+
+    Recent history is still in the hot table until archive_expired() moves it,
+    so both are read, each through its start_time index, and merged.
+    """
+    limit = request.args.get('limit', HISTORY_DEFAULT_LIMIT, type=int)
+    if limit is None or not 1 <= limit <= HISTORY_MAX_LIMIT:
+        return jsonify({"error": f"limit must be between 1 and {HISTORY_MAX_LIMIT}"}), 400
+    before = None
+    if 'before' in request.args:
+        try:
+            before = parse_local(request.args['before'])
+        except ValueError:
+            return jsonify({"error": "Invalid date format. Use YYYY-MM-DD HH:MM"}), 400
+    resource_id = request.args.get('resource_id', type=int)
+
+    rows = []
+    for model in (Reservation, ArchivedReservation):
+        query = model.query.filter(model.end_time <= now)
+        if model is Reservation:
+            query = query.filter(Reservation.blackout_id.is_(None))
+        if resource_id is not None:
+            query = query.filter(model.resource_id == resource_id)
+        if before is not None:
+            query = query.filter(model.start_time < before)
+        rows.extend(query.order_by(model.start_time.desc()).limit(limit))
+    rows.sort(key=lambda r: (r.start_time, r.id), reverse=True)
+    return reservation_list_response(rows[:limit])
+
+@bp.route('/summary', methods=['GET'])
+def get_summary():
+    """Per-day occupancy from daily_summary, without touching reservations.
+
+    `from` and `to` are PST dates (YYYY-MM-DD, `to` inclusive, default: `from`,
+    which defaults to today). Days with no bookings are omitted.
+    """
+    try:
+        first = (datetime.strptime(request.args['from'], '%Y-%m-%d').date() if 'from' in request.args
+                 else now_pst().date())
+        last = datetime.strptime(request.args['to'], '%Y-%m-%d').date() if 'to' in request.args else first
+    except ValueError:
+        return jsonify({"error": "Invalid date format. Use YYYY-MM-DD"}), 400
+    if not 1 <= (last - first).days + 1 <= SUMMARY_MAX_DAYS:
+        return jsonify({"error": f"Date range must cover between 1 and {SUMMARY_MAX_DAYS} days"}), 400
+
+    query = DailySummary.query.filter(DailySummary.day >= first, DailySummary.day <= last)
+    resource_id = request.args.get('resource_id', type=int)
+    if resource_id is not None:
+        query = query.filter(DailySummary.resource_id == resource_id)
+    rows = query.order_by(DailySummary.day, DailySummary.resource_id).all()
+    return jsonify([row.to_dict() for row in rows]), 200
+
+def analytics_engine():
+    """Engine for analytics reads: the ANALYTICS_DATABASE_URI replica if configured."""
+    return current_app.extensions.get('analytics_engine') or db.engine
 
-    reservations = query.order_by(Reservation.start_time).all()
-    return jsonify([r.to_dict() for r in reservations]), 200
+def elapsed_minutes(table):
+    """SQL expression for the length in minutes of reservation rows in `table`."""
+    if analytics_engine().dialect.name == 'sqlite':
+        return (func.julianday(table.c.end_time) - func.julianday(table.c.start_time)) * 1440
+    return extract('epoch', table.c.end_time - table.c.start_time) / 60
 
-@app.route('/')
+@bp.route('/analytics', methods=['GET'])
+def get_analytics():
+    """Utilization per day and hour of week, top users and the 409 rejection rate.
+
+    `from` and `to` are PST dates (YYYY-MM-DD, `to` inclusive, default: the last
+    30 days). Utilization comes from the daily_summary and hourly_usage
+    counters; top users and the rejection rate are one aggregate query each
+    over reservations starting in the range, live and archived. Everything is
+    read on analytics_engine(), never through the booking session. Other
+    databases read one REPEATABLE READ snapshot; on SQLite each statement is
+    its own short read, so a booking waits for at most one of them.
+    """
+    today = now_pst().date()
+    try:
+        last = datetime.strptime(request.args['to'], '%Y-%m-%d').date() if 'to' in request.args else today
+        first = (datetime.strptime(request.args['from'], '%Y-%m-%d').date() if 'from' in request.args
+                 else last - timedelta(days=ADVANCE_BOOKING_LIMIT.days - 1))
+    except ValueError:
+        return jsonify({"error": "Invalid date format. Use YYYY-MM-DD"}), 400
+    days = (last - first).days + 1
+    if not 1 <= days <= SUMMARY_MAX_DAYS:
+        return jsonify({"error": f"Date range must cover between 1 and {SUMMARY_MAX_DAYS} days"}), 400
+    top = request.args.get('top', ANALYTICS_DEFAULT_TOP, type=int)
+    if top is None or not 1 <= top <= ANALYTICS_MAX_TOP:
+        return jsonify({"error": f"top must be between 1 and {ANALYTICS_MAX_TOP}"}), 400
+    resource_id = request.args.get('resource_id', type=int)
+
+    range_start = datetime.combine(first, datetime.min.time())
+    range_end = range_start + timedelta(days=days)
+    daily_t, hourly_t = DailySummary.__table__, HourlyUsage.__table__
+    live_t, archive_t = Reservation.__table__, ArchivedReservation.__table__
+    rejection_t, user_t = BookingRejection.__table__, User.__table__
+
+    def scoped(query, table):
+        return query if resource_id is None else query.where(table.c.resource_id == resource_id)
+
+    bookings = union_all(
+        scoped(select(live_t.c.user_id, elapsed_minutes(live_t).label('minutes'))
+               .where(live_t.c.start_time >= range_start, live_t.c.start_time < range_end,
+                      live_t.c.blackout_id.is_(None)), live_t),
+        scoped(select(archive_t.c.user_id, elapsed_minutes(archive_t).label('minutes'))
+               .where(archive_t.c.start_time >= range_start, archive_t.c.start_time < range_end), archive_t),
+    ).subquery()
+
+    with analytics_engine().connect() as conn:
+        if conn.dialect.name != 'sqlite':
+            conn.execution_options(isolation_level='REPEATABLE READ')
+        with conn.begin():
+            resources = 1 if resource_id is not None else conn.execute(select(func.count()).select_from(Resource.__table__)).scalar()
+            daily = dict(conn.execute(scoped(
+                select(daily_t.c.day, func.sum(daily_t.c.booked_minutes))
+                .where(daily_t.c.day >= first, daily_t.c.day <= last), daily_t).group_by(daily_t.c.day)).all())
+            hourly = conn.execute(scoped(
+                select(hourly_t.c.day, hourly_t.c.hour, func.sum(hourly_t.c.booked_minutes))
+                .where(hourly_t.c.day >= first, hourly_t.c.day <= last), hourly_t)
+                .group_by(hourly_t.c.day, hourly_t.c.hour)).all()
+            top_users = conn.execute(
+                select(user_t.c.name, func.sum(bookings.c.minutes).label('minutes'), func.count().label('count'))
+                .join(user_t, user_t.c.id == bookings.c.user_id)
+                .group_by(user_t.c.id, user_t.c.name)
+                .order_by(literal_column('minutes').desc(), user_t.c.name).limit(top)).all()
+            created = conn.execute(select(func.count()).select_from(bookings)).scalar()
+            conflicts = conn.execute(scoped(
+                select(func.count()).select_from(rejection_t)
+                .where(rejection_t.c.start_time >= range_start, rejection_t.c.start_time < range_end),
+                rejection_t)).scalar()
+
+    def ratio(booked, capacity):
+        return round(booked / capacity, 4) if capacity else 0.0
+
+    daily_rows = []
+    weekday_count = [0] * 7
+    for i in range(days):
+        day = first + timedelta(days=i)
+        weekday_count[day.weekday()] += 1
+        day_start = datetime.combine(day, datetime.min.time())
+        day_minutes = (wall_to_epoch(day_start + timedelta(days=1)) - wall_to_epoch(day_start)) // 60
+        booked = daily.get(day, 0) or 0
+        daily_rows.append({"day": day.isoformat(), "booked_minutes": booked,
+                           "utilization": ratio(booked, day_minutes * resources)})
+
+    hour_of_week = [[0] * 24 for _ in range(7)]
+    for day, hour, booked in hourly:
+        hour_of_week[day.weekday()][hour] += booked
+    hour_of_week = [[ratio(booked, weekday_count[weekday] * 60 * resources) for booked in hours]
+                    for weekday, hours in enumerate(hour_of_week)]
+
+    return jsonify({
+        "from": first.isoformat(),
+        "to": last.isoformat(),
+        "resource_id": resource_id,
+        "resources": resources,
+        "daily": daily_rows,
+        "hour_of_week": hour_of_week,
+        "top_users": [{"username": username, "booked_hours": round(minutes / 60, 2), "reservations": count}
+                      for username, minutes, count in top_users],
+        "bookings": {"created": created, "conflicts": conflicts,
+                     "rejection_rate": ratio(conflicts, created + conflicts)},
+    }), 200
+
+@bp.route('/availability', methods=['GET'])
+def get_availability():
+    """Bookable 15-minute slots of one resource, run-length encoded.
+
+    `from` and `to` are PST dates (YYYY-MM-DD, `to` inclusive, default: `from`,
+    which defaults to today). `runs` alternates counts of bookable and
+    unavailable slots starting at `start`, beginning with a bookable run.
+    """
+    now = now_pst().replace(tzinfo=None)
+    try:
+        first = datetime.strptime(request.args['from'], '%Y-%m-%d') if 'from' in request.args else now.replace(hour=0, minute=0, second=0, microsecond=0)
+        last_day = datetime.strptime(request.args['to'], '%Y-%m-%d') if 'to' in request.args else first
+    except ValueError:
+        return jsonify({"error": "Invalid date format. Use YYYY-MM-DD"}), 400
+    days = (last_day - first).days + 1
+    if days < 1 or days > AVAILABILITY_MAX_DAYS:
+        return jsonify({"error": f"Date range must cover between 1 and {AVAILABILITY_MAX_DAYS} days"}), 400
+
+    resource_id = request.args.get('resource_id', type=int)
+    if resource_id is None:
+        resource_id = default_resource_id()
+    elif db.session.get(Resource, resource_id) is None:
+        return jsonify({"error": "Unknown resource"}), 400
+
+    taken = unavailable_slots(resource_id, first, days, now, booking_rules(resource_id).cutoff(now))
+    return jsonify({
+        'resource_id': resource_id,
+        'start': first.strftime('%Y-%m-%dT%H:%M'),
+        'slot_minutes': int(SLOT.total_seconds() // 60),
+        'slots': len(taken),
+        'runs': run_lengths(taken),
+        'blackouts': blackout_windows(resource_id, first, first + timedelta(days=days)),
+    }), 200
+
+def blackout_windows(resource_id, first, last):
+    """Blackout occurrences overlapping [first, last), with their pieces joined back up."""
+    rows = db.session.query(Reservation.start_time, Reservation.end_time, Blackout.id, Blackout.reason).join(
+        Blackout, Blackout.id == Reservation.blackout_id).filter(
+        Reservation.resource_id == resource_id,
+        Reservation.start_time > first - MAX_RESERVATION_DURATION,
+        Reservation.start_time < last,
+        Reservation.end_time > first,
+    ).order_by(Reservation.start_time)
+    windows = []
+    for start, end, blackout_id, reason in rows:
+        if windows and windows[-1]['blackout_id'] == blackout_id and windows[-1]['end'] == start:
+            windows[-1]['end'] = end
+        else:
+            windows.append({'blackout_id': blackout_id, 'start': start, 'end': end, 'reason': reason})
+    return [{'blackout_id': w['blackout_id'], 'start_time': format_local(w['start']),
+             'end_time': format_local(w['end']), 'reason': w['reason']} for w in windows]
+
+@bp.route('/availability/next', methods=['GET'])
+def next_available():
+    """First free windows of `duration` on one resource, after `after` (default now)."""
+    try:
+        duration = parse_duration(request.args.get('duration'))
+    except ValueError:
+        return jsonify({"error": "Invalid duration. Use e.g. 90m, 1h30m or 2h"}), 400
+
+    limit = request.args.get('limit', NEXT_AVAILABLE_DEFAULT_LIMIT, type=int)
+    if limit < 1 or limit > NEXT_AVAILABLE_MAX_LIMIT:
+        return jsonify({"error": f"limit must be between 1 and {NEXT_AVAILABLE_MAX_LIMIT}"}), 400
+
+    resource_id = request.args.get('resource_id', type=int)
+    if resource_id is None:
+        resource_id = default_resource_id()
+    elif db.session.get(Resource, resource_id) is None:
+        return jsonify({"error": "Unknown resource"}), 400
+    rules = booking_rules(resource_id)
+    if duration < rules.min_duration or duration > rules.max_duration:
+        return jsonify({"error": f"Duration must be between {rules.min_duration.total_seconds() / 60} minutes and {rules.max_duration.total_seconds() / 3600} hours"}), 400
+
+    now = now_pst().replace(tzinfo=None)
+    after = now
+    if 'after' in request.args:
+        try:
+            after = max(parse_local(request.args['after']), now)
+        except ValueError:
+            return jsonify({"error": "Invalid date format. Use YYYY-MM-DD HH:MM"}), 400
+    # Bookings must start strictly in the future.
+    if after == now:
+        after += timedelta(microseconds=1)
+
+    windows = []
+    for start, end, gap_end in iter_free_windows(resource_id, after, rules.cutoff(now), duration):
+        windows.append({
+            'start_time': format_local(start),
+            'end_time': format_local(end),
+            'free_until': format_local(gap_end) if gap_end is not None else None,
+        })
+        if len(windows) == limit:
+            break
+
+    return jsonify({
+        'resource_id': resource_id,
+        'duration_minutes': int(duration.total_seconds() // 60),
+        'windows': windows,
+    }), 200
+
+@bp.route('/resources', methods=['GET'])
+def get_resources():
+    resources = Resource.query.order_by(Resource.name).all()
+    return jsonify([r.to_dict() for r in resources]), 200
+
+@bp.route('/resources', methods=['POST'])
+def create_resource():
+    body, error = decode_body(RESOURCE)
+    if error:
+        return error
+    name, pool = body.name, body.pool
+    if not name.strip():
+        return jsonify({"error": "Missing required fields"}), 400
+    if pool is not None and not pool.strip():
+        return jsonify({"error": "Pool must be a non-empty string"}), 400
+    if Resource.query.filter_by(name=name.strip()).first() is not None:
+        return jsonify({"error": "A resource with that name already exists"}), 409
+
+    resource = Resource(name=name.strip(), pool=pool.strip() if pool else None)
+    db.session.add(resource)
+    db.session.commit()
+    return jsonify(resource.to_dict()), 201
+
+@bp.route('/blackouts', methods=['GET'])
+def list_blackouts():
+    query = Blackout.query
+    resource_id = request.args.get('resource_id', type=int)
+    if resource_id is not None:
+        query = query.filter_by(resource_id=resource_id)
+    return jsonify([b.to_dict() for b in query.order_by(Blackout.start_time)]), 200
+
+@bp.route('/blackouts', methods=['POST'])
+def create_blackout():
+    """Blocks a resource once or on a daily/weekly schedule.
+
+    Occurrences within the booking horizon are written at once; a later one is
+    written by the archive pass as its day comes into the horizon. Returns 409
+    with the overlapping reservations if a booking is in the way.
+    """
+    body, error = decode_body(BLACKOUT)
+    if error:
+        return error
+    resource_id = body.resource_id if body.resource_id is not None else default_resource_id()
+    if db.session.get(Resource, resource_id) is None:
+        return jsonify({"error": "Unknown resource"}), 400
+    try:
+        start, end = parse_local(body.start_time), parse_local(body.end_time)
+        until = datetime.strptime(body.until, '%Y-%m-%d').date() if body.until else None
+    except ValueError:
+        return jsonify({"error": "Invalid date format. Use YYYY-MM-DD HH:MM (and YYYY-MM-DD for until)"}), 400
+    recurrence = body.recurrence
+    if recurrence is not None and recurrence not in BLACKOUT_PERIODS:
+        return jsonify({"error": f"recurrence must be one of {', '.join(BLACKOUT_PERIODS)}"}), 400
+    if end <= start:
+        return jsonify({"error": "End time must be after start time"}), 400
+    if recurrence is not None and end - start >= BLACKOUT_PERIODS[recurrence]:
+        return jsonify({"error": f"A {recurrence} blackout must be shorter than its period"}), 400
+    reason = body.reason
+
+    now = now_pst().replace(tzinfo=None)
+    begin_booking()
+    user_id = intern_user(BLACKOUT_USERNAME)
+    version = lock_resource(resource_id)
+    # An occurrence in progress started less than one period ago.
+    blackout = Blackout(resource_id=resource_id, start_time=start, end_time=end, recurrence=recurrence, until=until,
+                        reason=reason, materialized_until=start if recurrence is None
+                        else max(start, now - BLACKOUT_PERIODS[recurrence]))
+    db.session.add(blackout)
+    db.session.flush()
+    conflicts = materialize_blackout(blackout, blackout_horizon(now), user_id)
+    if conflicts:
+        db.session.rollback()
+        return jsonify({
+            "error": "The blackout overlaps existing reservations",
+            "conflicts": [r.to_dict() for r in conflicts[:CONFLICT_BLOCKER_LIMIT]],
+            "conflict_count": len(conflicts),
+        }), 409
+    bump_version(resource_id, version)
+    db.session.commit()
+    schedule_index().invalidate(resource_id)
+    return jsonify(blackout.to_dict()), 201
+
+@bp.route('/blackouts/<int:blackout_id>', methods=['DELETE'])
+def delete_blackout(blackout_id):
+    """Removes a blackout and all its pieces; waitlisted requests that now fit are booked."""
+    begin_booking()
+    blackout = db.session.get(Blackout, blackout_id)
+    if blackout is None:
+        return jsonify({"error": "No such blackout"}), 404
+    resource_id = blackout.resource_id
+    version = lock_resource(resource_id)
+    pieces = Reservation.query.filter_by(blackout_id=blackout_id).all()
+    for piece in pieces:
+        db.session.delete(piece)
+    db.session.delete(blackout)
+    bump_version(resource_id, version)
+    db.session.flush()
+    promoted = []
+    for piece in pieces:
+        promoted += promote_waiters(resource_id, piece.start_time, piece.end_time)
+    db.session.commit()
+    schedule_index().invalidate(resource_id)
+    for booked in promoted:
+        apply_booking(*booked)
+    return jsonify({"deleted": blackout_id}), 200
+
+@bp.route('/')
 def index():
-    return render_template('index.html')
+    # The page only depends on constants, so it is rendered (and compressed)
+    # once per worker unless templates are being edited.
+    entry = response_cache().get('index')
+    if entry is None or current_app.templates_auto_reload:
+        page = render_template(
+            'index.html',
+            max_reservation_minutes=int(MAX_RESERVATION_DURATION.total_seconds() // 60),
+            advance_booking_days=ADVANCE_BOOKING_LIMIT.days,
+        )
+        entry = response_cache().put('index', CachedBody(page.encode('utf-8'), 'text/html'))
+    return send_cached(entry)
 
-if __name__ == '__main__':
-    with app.app_context():
-        db.create_all()
+@bp.route('/assets/<path:filename>')
+def asset(filename):
+    """A static file by its content-hashed name (see assets.py); never changes."""
+    entry = current_app.extensions['assets'].body(filename)
+    if entry is None:
+        return jsonify({"error": "No such asset"}), 404
+    response = send_cached(entry)
+    response.cache_control.public = True
+    response.cache_control.max_age = IMMUTABLE_MAX_AGE
+    response.cache_control.immutable = True
+    return response
+
+@bp.app_context_processor
+def asset_helpers():
+    return {'asset_url': current_app.extensions['assets'].url}
+
+def add_missing_columns(table, existing):
+    """ALTER TABLE ADD COLUMN for each of `table`'s model columns not in `existing`.
+
+    Columns are added without NOT NULL unless the model gives them a constant
+    default, since existing rows have no value for them yet.
+    """
+    dialect = db.engine.dialect
+    quote = dialect.identifier_preparer.quote
+    for column in table.columns:
+        if column.name in existing:
+            continue
+        ddl = f'ALTER TABLE {quote(table.name)} ADD COLUMN {quote(column.name)} {column.type.compile(dialect=dialect)}'
+        default = column.default.arg if column.default is not None and column.default.is_scalar else None
+        if default is not None:
+            ddl += f' DEFAULT {int(default)}' if isinstance(default, (bool, int)) else f" DEFAULT '{default}'"
+            if not column.nullable:
+                ddl += ' NOT NULL'
+        db.session.execute(text(ddl))
+
+def intern_usernames(table, inspector):
+    """Replaces `table`'s username column with user_id, creating users as needed."""
+    quote = db.engine.dialect.identifier_preparer.quote
+    name, users = quote(table.name), quote(User.__tablename__)
+    db.session.execute(text(
+        f'INSERT INTO {users} (name) SELECT DISTINCT username FROM {name} '
+        f'WHERE username NOT IN (SELECT name FROM {users})'))
+    db.session.execute(text(
+        f'UPDATE {name} SET user_id = (SELECT id FROM {users} WHERE {users}.name = {name}.username)'))
+    # SQLite cannot drop an indexed column.
+    for index in inspector.get_indexes(table.name):
+        if 'username' in index['column_names']:
+            db.session.execute(text(f'DROP INDEX {quote(index["name"])}'))
+    db.session.execute(text(f'ALTER TABLE {name} DROP COLUMN username'))
+
+def upgrade_schema():
+    """Brings tables made by an older version of the app up to the current models.
+
+    db.create_all() only creates missing tables. Here, columns added to
+    existing tables since are created, reservations made before resources
+    existed are put on the default resource, usernames stored on each row are
+    moved to the user table, and missing indexes are built.
+    """
+    inspector = inspect(db.engine)
+    tables = set(inspector.get_table_names())
+    upgraded = []
+    for table in db.metadata.sorted_tables:
+        if table.name not in tables:
+            continue
+        existing = {column['name'] for column in inspector.get_columns(table.name)}
+        if existing.issuperset(table.columns.keys()):
+            continue
+        if table is UsageLedger.__table__:
+            # Keyed by username before users were interned; the ledger is
+            # derived data, so it is recreated and rebuilt by create_app().
+            db.session.commit()
+            table.drop(db.engine)
+            table.create(db.engine)
+            continue
+        add_missing_columns(table, existing)
+        if 'resource_id' not in existing and table.name in ('reservation', 'archived_reservation'):
+            db.session.execute(text(f'UPDATE {table.name} SET resource_id = :id WHERE resource_id IS NULL'),
+                               {'id': default_resource_id()})
+        if 'username' in existing and 'user_id' not in existing:
+            intern_usernames(table, inspector)
+        upgraded.append(table)
+    db.session.commit()
+    for table in upgraded:
+        for index in table.indexes:
+            index.create(db.engine, checkfirst=True)
+
+def create_app(config=None):
+    """Builds a configured application.
+
+    Configuration is layered: DEFAULT_CONFIG, then the RESERVATION_DATABASE_URI
+    and RESERVATION_PRIORITY_TOKEN environment variables, then the `config`
+    mapping passed by the caller.
+    """
+    app = Flask(__name__)
+    app.config.update(DEFAULT_CONFIG)
+    if 'RESERVATION_DATABASE_URI' in os.environ:
+        app.config['SQLALCHEMY_DATABASE_URI'] = os.environ['RESERVATION_DATABASE_URI']
+    if 'RESERVATION_PRIORITY_TOKEN' in os.environ:
+        app.config['PRIORITY_TOKEN'] = os.environ['RESERVATION_PRIORITY_TOKEN']
+    if config:
+        app.config.update(config)
+    if app.config['SQLALCHEMY_DATABASE_URI'].startswith('sqlite'):
+        # Python's sqlite3 default of 5 seconds is shorter than a burst of
+        # queued bookings can take to drain.
+        options = dict(app.config.get('SQLALCHEMY_ENGINE_OPTIONS') or {})
+        connect_args = dict(options.get('connect_args') or {})
+        connect_args.setdefault('timeout', app.config['SQLITE_BUSY_TIMEOUT_SECONDS'])
+        options['connect_args'] = connect_args
+        app.config['SQLALCHEMY_ENGINE_OPTIONS'] = options
+
+    db.init_app(app)
+    app.register_blueprint(bp)
+    app.cli.add_command(archive_command)
+    if app.config['ANALYTICS_DATABASE_URI']:
+        app.extensions['analytics_engine'] = create_engine(app.config['ANALYTICS_DATABASE_URI'])
+    app.extensions['user_ids'] = {}
+    app.extensions['opening_rounds'] = set()
+    app.extensions['response_cache'] = BodyCache(app.config['RESPONSE_CACHE_ENTRIES'])
+    app.extensions['assets'] = AssetManifest(app.static_folder)
+    app.extensions['hold_wheel'] = TimingWheel(tick=app.config['HOLD_SWEEP_SECONDS'])
+    app.extensions['rules'] = RuleBook(
+        {'min_minutes': int(MIN_RESERVATION_DURATION.total_seconds() // 60),
+         'max_minutes': int(MAX_RESERVATION_DURATION.total_seconds() // 60),
+         'advance_days': ADVANCE_BOOKING_LIMIT.days},
+        advance_booking_cutoff, path=app.config['RULES_FILE'],
+        reload_seconds=app.config['RULES_RELOAD_SECONDS'], logger=app.logger)
+    app.extensions['schedule_index'] = ScheduleIndex(
+        slack_cap_slots=int(MAX_RESERVATION_DURATION / SLOT),
+        sync_interval=app.config['SCHEDULE_INDEX_SYNC_SECONDS'],
+    )
+
+    if app.config['BOOTSTRAP_SCHEMA']:
+        with app.app_context():
+            db.create_all()
+            if default_resource_id() is None:
+                db.session.add(Resource(name=DEFAULT_RESOURCE_NAME))
+                db.session.commit()
+            upgrade_schema()
+            # A database from before the summary tables existed gets them filled once.
+            if ((DailySummary.query.first() is None or HourlyUsage.query.first() is None)
+                    and (Reservation.query.first() or ArchivedReservation.query.first())):
+                rebuild_daily_summary()
+            if UsageLedger.query.first() is None and Reservation.query.first() is not None:
+                rebuild_usage_ledger()
 
-    app.run(host='0.0.0.0', debug=True)
-    app.run(debug=True)
+    if app.config['ARCHIVE_INTERVAL_SECONDS'] and not app.testing:
+        start_archiver(app)
+    if not app.testing:
+        start_hold_sweeper(app)
+
+    return app
+
+_default_app = None
+
+def __getattr__(name):
+    # `app` is built on first access (e.g. by gunicorn's `app:app`), so importing
+    # this module for create_app(), models or constants does not construct an app.
+    global _default_app
+    if name == 'app':
+        if _default_app is None:
+            _default_app = create_app()
+        return _default_app
+    raise AttributeError(f"module {__name__!r} has no attribute {name!r}")
+
+if __name__ == '__main__':
+    create_app().run(host='0.0.0.0', debug=True)
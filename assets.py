@@ -0,0 +1,72 @@
+"""Self-hosted front-end assets served under content-hashed URLs.
+
+Every file under the app's static folder is hashed once at startup. asset_url()
+(available in templates) maps a path such as `vendor/jquery-3.6.4.min.js` to
+`/assets/vendor/jquery-3.6.4.min.<hash>.js`. Since a URL names exactly one
+version of a file, it is served with a one-year `immutable` Cache-Control and
+browsers never revalidate it. Changing a file changes its URL on the next
+restart. A request for an old hash gets a 404 and is never served stale
+content.
+
+The third-party libraries the page uses are pinned in VENDOR, next to the
+upstream URL each copy came from. `python tools/vendor_assets.py` downloads
+any that are missing into static/vendor/. Until a file has been vendored,
+asset_url() returns its pinned upstream URL, so a partial checkout still
+renders.
+"""
+import hashlib
+import mimetypes
+import os
+
+from compression import CachedBody
+
+URL_PREFIX = '/assets/'
+IMMUTABLE_MAX_AGE = 365 * 24 * 3600
+
+# Local path under static/ -> pinned upstream copy. jQuery is checked in; it is
+# the upstream 3.6.4 build, byte for byte the copy Django's admin vendors. The
+# others are served from these URLs until tools/vendor_assets.py fetches them.
+VENDOR = {
+    'vendor/bootswatch-darkly-4.5.2.min.css': 'https://cdn.jsdelivr.net/npm/bootswatch@4.5.2/dist/darkly/bootstrap.min.css',
+    'vendor/flatpickr-dark-4.6.13.css': 'https://cdn.jsdelivr.net/npm/flatpickr@4.6.13/dist/themes/dark.css',
+    'vendor/jquery-3.6.4.min.js': 'https://code.jquery.com/jquery-3.6.4.min.js',
+    'vendor/flatpickr-4.6.13.min.js': 'https://cdn.jsdelivr.net/npm/flatpickr@4.6.13/dist/flatpickr.min.js',
+}
+
+def fingerprint(path, data):
+    """`dir/name.min.js` -> `dir/name.min.<first 12 hex of sha256>.js`."""
+    stem, ext = os.path.splitext(path)
+    return f'{stem}.{hashlib.sha256(data).hexdigest()[:12]}{ext}'
+
+class AssetManifest:
+    """Content-hashed names for the files under `root`, read once."""
+
+    def __init__(self, root):
+        self.root = root
+        self._urls = {}     # path under root -> hashed URL
+        self._bodies = {}   # hashed path -> CachedBody
+        if root is None or not os.path.isdir(root):
+            return
+        for directory, _, names in os.walk(root):
+            for name in sorted(names):
+                full = os.path.join(directory, name)
+                path = os.path.relpath(full, root).replace(os.sep, '/')
+                with open(full, 'rb') as f:
+                    data = f.read()
+                hashed = fingerprint(path, data)
+                mimetype = mimetypes.guess_type(name)[0] or 'application/octet-stream'
+                self._urls[path] = URL_PREFIX + hashed
+                self._bodies[hashed] = CachedBody(data, mimetype)
+
+    def url(self, path):
+        """Hashed URL of a static file, or its pinned upstream URL if not vendored yet."""
+        url = self._urls.get(path)
+        if url is not None:
+            return url
+        if path in VENDOR:
+            return VENDOR[path]
+        raise KeyError(f'unknown asset: {path}')
+
+    def body(self, hashed_path):
+        """The CachedBody for a hashed path, or None if no current file has that hash."""
+        return self._bodies.get(hashed_path)
@@ -0,0 +1,109 @@
+"""gzip and brotli content negotiation, with a cache of precompressed bodies.
+
+choose_encoding() picks the best encoding the client accepts. brotli is
+offered only when the optional `brotli` package is installed.
+
+Most responses are compressed once per request by the app's after_request
+hook. Responses that are cheap to reuse are instead kept in a BodyCache as
+CachedBody entries, for example a listing at one data version or the rendered
+page. Each compressed variant of a cached body is made the first time a client
+asks for that encoding and then kept with the body. That costs one compression
+per body and encoding instead of one per request. Both paths use the same
+moderate levels, since a cached variant is still made on the request thread
+of whichever client first asks for it.
+"""
+import gzip
+import threading
+from collections import OrderedDict
+
+try:
+    import brotli
+except ImportError:  # optional dependency
+    brotli = None
+
+# Best first; werkzeug's best_match breaks quality ties in this order.
+ENCODINGS = ('br', 'gzip') if brotli is not None else ('gzip',)
+
+# Mimetypes worth compressing. Everything else (images, already compressed
+# data) is sent as is.
+COMPRESSIBLE = frozenset([
+    'application/json', 'application/msgpack', 'application/javascript',
+    'text/html', 'text/css', 'text/javascript', 'text/plain', 'image/svg+xml',
+])
+
+# gzip 9 and brotli 11 shave a few percent off at several times the CPU cost.
+LEVELS = {'gzip': 6, 'br': 5}
+
+def choose_encoding(accept_encodings):
+    """Best of ENCODINGS for a werkzeug Accept-Encoding header, or None for identity."""
+    return accept_encodings.best_match(ENCODINGS)
+
+def compressible(mimetype):
+    return mimetype in COMPRESSIBLE
+
+def compress(body, encoding, levels=LEVELS):
+    if encoding == 'gzip':
+        # mtime=0 keeps the output identical for identical input.
+        return gzip.compress(body, compresslevel=levels['gzip'], mtime=0)
+    if encoding == 'br':
+        return brotli.compress(body, quality=levels['br'])
+    raise ValueError(f'unsupported encoding: {encoding}')
+
+class CachedBody:
+    """A response body, its compressed variants, and how long it stays valid.
+
+    `valid_until` is compared with whatever clock the caller passes to
+    BodyCache.get(), and None means until evicted.
+    """
+    __slots__ = ('body', 'mimetype', 'valid_until', '_variants', '_lock')
+
+    def __init__(self, body, mimetype, valid_until=None):
+        self.body = body
+        self.mimetype = mimetype
+        self.valid_until = valid_until
+        self._variants = {}
+        self._lock = threading.Lock()
+
+    def variant(self, encoding):
+        """The body compressed with `encoding`, made on first use."""
+        data = self._variants.get(encoding)
+        if data is None:
+            # One thread compresses; concurrent requests for it wait instead
+            # of repeating the work.
+            with self._lock:
+                data = self._variants.get(encoding)
+                if data is None:
+                    data = compress(self.body, encoding)
+                    self._variants[encoding] = data
+        return data
+
+class BodyCache:
+    """A small thread-safe LRU of CachedBody entries."""
+
+    def __init__(self, max_entries):
+        self.max_entries = max_entries
+        self._entries = OrderedDict()
+        self._lock = threading.Lock()
+
+    def get(self, key, now=None):
+        """The entry for `key` if present and, when it expires, not past it at `now`."""
+        with self._lock:
+            entry = self._entries.get(key)
+            if entry is None:
+                return None
+            if entry.valid_until is not None and now is not None and now >= entry.valid_until:
+                del self._entries[key]
+                return None
+            self._entries.move_to_end(key)
+            return entry
+
+    def put(self, key, entry):
+        with self._lock:
+            self._entries[key] = entry
+            self._entries.move_to_end(key)
+            while len(self._entries) > self.max_entries:
+                self._entries.popitem(last=False)
+        return entry
+
+    def __len__(self):
+        return len(self._entries)
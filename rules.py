@@ -0,0 +1,185 @@
+"""Per-resource booking rules, compiled into check pipelines and hot-reloaded.
+
+The built-in limits (minimum and maximum duration, how many days ahead a
+booking may start) can be tightened per pool and per resource in a JSON file:
+
+    {
+        "default":   {"min_minutes": 15, "max_minutes": 240, "advance_days": 30},
+        "pools":     {"gpu": {"max_minutes": 60}},
+        "resources": {"gpu-1": {"advance_days": 7}}
+    }
+
+A resource gets the defaults, overridden by its pool's entry, overridden by
+its own entry. Each resolved rule set is compiled once into an ordered list of
+checks, with no-op checks left out and the cheapest ones first, and cached per
+resource. The file is re-read when its modification time changes (looked at
+most every `reload_seconds`), so workers pick up edits without a restart. A
+file that fails to parse is logged and the previous rules stay in force.
+
+The maximum duration and advance days may not exceed the built-in values.
+Conflict queries rely on no reservation being longer than the built-in
+maximum.
+"""
+import json
+import logging
+import os
+import threading
+import time
+from datetime import timedelta
+
+_FIELDS = {'min_minutes', 'max_minutes', 'advance_days'}
+
+class RuleError(ValueError):
+    """A rules file that cannot be used."""
+
+class RuleSet:
+    """Resolved limits for one resource or pool, with its compiled checks."""
+    __slots__ = ('min_duration', 'max_duration', 'advance_limit', '_cutoff', '_checks')
+
+    def __init__(self, min_duration, max_duration, advance_limit, cutoff):
+        self.min_duration = min_duration
+        self.max_duration = max_duration
+        self.advance_limit = advance_limit
+        self._cutoff = cutoff
+        self._checks = self._compile()
+
+    def cutoff(self, now):
+        """First naive wall-clock time too far ahead to book under these rules."""
+        return self._cutoff(now, self.advance_limit)
+
+    def check(self, start, end, now):
+        """Error message for aware datetimes [start, end) booked at `now`, or None."""
+        for check in self._checks:
+            error = check(start, end, now)
+            if error:
+                return error
+        return None
+
+    def _compile(self):
+        # (cost, check) pairs; the sort puts plain comparisons before the
+        # subtraction-based ones and the calendar arithmetic last.
+        checks = [(0, _ordered)]
+        if self.min_duration > timedelta(0):
+            checks.append((1, self._min_check))
+        checks.append((1, self._max_check))
+        checks.append((2, self._advance_check))
+        return [check for _, check in sorted(checks, key=lambda c: c[0])]
+
+    def _min_check(self, start, end, now):
+        if end - start < self.min_duration:
+            return f"Minimum reservation duration is {self.min_duration.total_seconds() / 60} minutes"
+
+    def _max_check(self, start, end, now):
+        if end - start > self.max_duration:
+            return f"Maximum reservation duration is {self.max_duration.total_seconds() / 3600} hours"
+
+    def _advance_check(self, start, end, now):
+        cutoff = self.cutoff(now)
+        if start.replace(tzinfo=None) >= cutoff:
+            # To display a user-friendly "last allowed day"
+            last_allowed_day = cutoff - timedelta(days=1)
+            return (f"Reservations can only be made up to {self.advance_limit.days} days in advance "
+                    f"(last available day is {last_allowed_day.strftime('%Y-%m-%d')})")
+
+def _ordered(start, end, now):
+    if end <= start:
+        return "End time must be after start time"
+
+def _overrides(section, where, ceilings):
+    if not isinstance(section, dict) or not set(section) <= _FIELDS:
+        raise RuleError(f'{where}: expected an object with keys from {sorted(_FIELDS)}')
+    for key, value in section.items():
+        if not isinstance(value, int) or isinstance(value, bool) or value < 0:
+            raise RuleError(f'{where}.{key}: expected a non-negative integer')
+        # A minimum can be raised, but not past the longest allowed booking.
+        limit = ceilings['max_minutes' if key == 'min_minutes' else key]
+        if value > limit:
+            raise RuleError(f'{where}.{key}: {value} exceeds the built-in limit of {limit}')
+    return section
+
+def parse_rules(text, ceilings):
+    """Validates a rules document; returns (default, pools, resources) override dicts."""
+    try:
+        document = json.loads(text)
+    except ValueError as e:
+        raise RuleError(f'invalid JSON: {e}') from None
+    if not isinstance(document, dict) or not set(document) <= {'default', 'pools', 'resources'}:
+        raise RuleError('expected an object with "default", "pools" and/or "resources"')
+    default = _overrides(document.get('default', {}), 'default', ceilings)
+    groups = []
+    for name in ('pools', 'resources'):
+        entries = document.get(name, {})
+        if not isinstance(entries, dict):
+            raise RuleError(f'{name}: expected an object keyed by name')
+        groups.append({key: _overrides(value, f'{name}.{key}', ceilings) for key, value in entries.items()})
+    return default, groups[0], groups[1]
+
+class RuleBook:
+    """Compiled rule sets by resource, backed by an optional hot-reloaded file.
+
+    `defaults` and ceilings are {'min_minutes', 'max_minutes', 'advance_days'};
+    `cutoff(now, advance_limit)` computes the advance booking cutoff.
+    """
+
+    def __init__(self, defaults, cutoff, path=None, reload_seconds=2.0, logger=None):
+        self.ceilings = dict(defaults)
+        self.path = path
+        self.reload_seconds = reload_seconds
+        self._cutoff = cutoff
+        self._logger = logger or logging.getLogger(__name__)
+        self._lock = threading.Lock()
+        self._overrides = ({}, {}, {})
+        self._compiled = {}     # ('resource', id) or ('pool', name) -> RuleSet
+        self._mtime = None
+        self._checked_at = None
+        if path is not None:
+            self._reload(force=True)
+
+    def for_resource(self, resource_id, describe):
+        """Rules for a resource; describe() returns its (name, pool) on a cache miss."""
+        return self._get(('resource', resource_id), lambda: self._resolve(*describe()))
+
+    def for_pool(self, pool):
+        """Rules for a pooled booking, before a member is chosen."""
+        return self._get(('pool', pool), lambda: self._resolve(None, pool))
+
+    def _get(self, key, build):
+        self._reload()
+        with self._lock:
+            rules = self._compiled.get(key)
+        if rules is None:
+            rules = build()
+            with self._lock:
+                self._compiled[key] = rules
+        return rules
+
+    def _resolve(self, name, pool):
+        default, pools, resources = self._overrides
+        merged = dict(self.ceilings)
+        merged.update(default)
+        merged.update(pools.get(pool, {}) if pool is not None else {})
+        merged.update(resources.get(name, {}) if name is not None else {})
+        return RuleSet(timedelta(minutes=merged['min_minutes']), timedelta(minutes=merged['max_minutes']),
+                       timedelta(days=merged['advance_days']), self._cutoff)
+
+    def _reload(self, force=False):
+        if self.path is None:
+            return
+        now = time.monotonic()
+        with self._lock:
+            if not force and self._checked_at is not None and now - self._checked_at < self.reload_seconds:
+                return
+            self._checked_at = now
+        try:
+            mtime = os.stat(self.path).st_mtime_ns
+            if mtime == self._mtime:
+                return
+            with open(self.path, encoding='utf-8') as f:
+                overrides = parse_rules(f.read(), self.ceilings)
+        except (OSError, RuleError) as e:
+            self._logger.error('Keeping the current booking rules; %s: %s', self.path, e)
+            return
+        with self._lock:
+            self._overrides = overrides
+            self._compiled = {}
+            self._mtime = mtime
@@ -0,0 +1,315 @@
+"""In-memory schedule index used to pick a free resource from a pool.
+
+Each resource's upcoming busy intervals are kept in a sorted Timeline. On top
+of that the index keeps one bitmask per 15-minute slot, with bit `resource_id`
+set when that resource has any busy time in the slot. Pool membership is also a
+bitmask, so the set of pool members free over a request is a handful of integer
+ANDs over the slots the request touches. The cost does not depend on the number
+of members.
+
+Best fit: among the free members, choose the one whose surrounding free gap is
+tightest, so large gaps stay available for long bookings. The gap is measured
+in whole slots and capped at `slack_cap_slots` per side; a leftover at least
+that long fits any booking and is not fragmentation.
+
+The index never talks to the database. The app loads timelines into it along
+with each resource's version counter. Before acting on a choice, the app locks
+the resource row and compares versions, so a stale index is detected and
+reloaded, never trusted.
+"""
+import threading
+import time
+from bisect import bisect_left, bisect_right
+from datetime import datetime, timedelta
+
+SLOT = timedelta(minutes=15)
+_SLOT_SECONDS = int(SLOT.total_seconds())
+_EPOCH = datetime(1970, 1, 1)
+
+def _seconds(wall):
+    return int((wall - _EPOCH).total_seconds())
+
+def slot_of(wall):
+    """Index of the 15-minute slot containing a naive wall-clock time."""
+    return _seconds(wall) // _SLOT_SECONDS
+
+def slot_start(slot):
+    return _EPOCH + timedelta(seconds=slot * _SLOT_SECONDS)
+
+def _touched_slots(start, end):
+    """First and last slot overlapped by [start, end)."""
+    return _seconds(start) // _SLOT_SECONDS, (_seconds(end) - 1) // _SLOT_SECONDS
+
+def _lowest_bit(mask):
+    return (mask & -mask).bit_length() - 1
+
+def _bits(mask):
+    while mask:
+        low = mask & -mask
+        yield low.bit_length() - 1
+        mask ^= low
+
+class Timeline:
+    """Non-overlapping busy intervals of one resource, sorted by start time."""
+    __slots__ = ('starts', 'ends', 'version')
+
+    def __init__(self, intervals=(), version=0):
+        intervals = sorted(intervals)
+        self.starts = [s for s, _ in intervals]
+        self.ends = [e for _, e in intervals]
+        self.version = version
+
+    def __len__(self):
+        return len(self.starts)
+
+    def intervals(self):
+        return list(zip(self.starts, self.ends))
+
+    def is_free(self, start, end):
+        # Intervals don't overlap, so ends are sorted too: the first interval
+        # ending after `start` is the only one that can overlap.
+        i = bisect_right(self.ends, start)
+        return i == len(self.starts) or self.starts[i] >= end
+
+    def free_gap(self, start, end):
+        """Bounds of the free gap containing [start, end); None means unbounded."""
+        i = bisect_right(self.ends, start)
+        return (self.ends[i - 1] if i else None,
+                self.starts[i] if i < len(self.starts) else None)
+
+    def add(self, start, end):
+        i = bisect_left(self.starts, start)
+        self.starts.insert(i, start)
+        self.ends.insert(i, end)
+
+    def remove(self, start, end):
+        i = bisect_left(self.starts, start)
+        while i < len(self.starts) and self.starts[i] == start:
+            if self.ends[i] == end:
+                del self.starts[i]
+                del self.ends[i]
+                return True
+            i += 1
+        return False
+
+class ScheduleIndex:
+    def __init__(self, slack_cap_slots, sync_interval=5.0):
+        self.slack_cap_slots = slack_cap_slots
+        self.sync_interval = sync_interval
+        self._lock = threading.RLock()
+        self._timelines = {}  # resource_id -> Timeline
+        self._busy = {}       # slot -> bitmask of resource ids busy in that slot
+        self._pools = {}      # pool name -> bitmask of member resource ids
+        self._loaded = 0      # bitmask of resource ids with a timeline
+        self._synced_at = {}  # pool name -> time.monotonic() of the last full sync
+
+    # -- loading -----------------------------------------------------------
+
+    def needs_sync(self, pool):
+        with self._lock:
+            synced = self._synced_at.get(pool)
+            return synced is None or time.monotonic() - synced > self.sync_interval
+
+    def set_pool(self, pool, versions):
+        """Records pool membership from {resource_id: version}.
+
+        Returns the members whose timelines are missing or out of date; the
+        caller loads them with load().
+        """
+        with self._lock:
+            mask = 0
+            for rid in versions:
+                mask |= 1 << rid
+            self._pools[pool] = mask
+            self._synced_at[pool] = time.monotonic()
+            return [rid for rid, v in versions.items()
+                    if rid not in self._timelines or self._timelines[rid].version != v]
+
+    def load(self, resource_id, version, intervals):
+        """Replaces one resource's timeline with `intervals` at `version`."""
+        with self._lock:
+            self._drop(resource_id)
+            timeline = Timeline(intervals, version)
+            self._timelines[resource_id] = timeline
+            bit = 1 << resource_id
+            self._loaded |= bit
+            for start, end in zip(timeline.starts, timeline.ends):
+                self._mark(bit, start, end)
+
+    def invalidate(self, resource_id):
+        with self._lock:
+            self._drop(resource_id)
+
+    def version(self, resource_id):
+        with self._lock:
+            timeline = self._timelines.get(resource_id)
+            return None if timeline is None else timeline.version
+
+    def timeline(self, resource_id):
+        with self._lock:
+            return self._timelines.get(resource_id)
+
+    def record(self, resource_id, start, end, version):
+        """Applies a committed booking that moved the resource to `version`.
+
+        If the index didn't hold the previous version the timeline is dropped
+        and reloaded on next use instead.
+        """
+        with self._lock:
+            timeline = self._timelines.get(resource_id)
+            if timeline is None:
+                return
+            if timeline.version != version - 1:
+                self._drop(resource_id)
+                return
+            timeline.add(start, end)
+            timeline.version = version
+            self._mark(1 << resource_id, start, end)
+
+    def unrecord(self, resource_id, start, end, version):
+        """Applies a committed removal of [start, end) that moved the resource to `version`.
+
+        Like record(), an unexpected version drops the timeline instead.
+        """
+        with self._lock:
+            timeline = self._timelines.get(resource_id)
+            if timeline is None:
+                return
+            if timeline.version != version - 1 or not timeline.remove(start, end):
+                self._drop(resource_id)
+                return
+            timeline.version = version
+            self._unmark(resource_id, timeline, start, end)
+
+    def move(self, resource_id, old_start, old_end, start, end, version):
+        """Applies a committed change of one interval to [start, end) at `version`.
+
+        Like record(), an unexpected version drops the timeline instead.
+        """
+        with self._lock:
+            timeline = self._timelines.get(resource_id)
+            if timeline is None:
+                return
+            if timeline.version != version - 1 or not timeline.remove(old_start, old_end):
+                self._drop(resource_id)
+                return
+            self._unmark(resource_id, timeline, old_start, old_end)
+            timeline.add(start, end)
+            timeline.version = version
+            self._mark(1 << resource_id, start, end)
+
+    def touch(self, resource_id, version):
+        """Applies a committed write that moved the resource to `version` without
+        changing its busy intervals, such as a confirmed hold.
+
+        Like record(), an unexpected version drops the timeline instead.
+        """
+        with self._lock:
+            timeline = self._timelines.get(resource_id)
+            if timeline is None:
+                return
+            if timeline.version != version - 1:
+                self._drop(resource_id)
+                return
+            timeline.version = version
+
+    def prune(self, before):
+        """Forgets busy slots that end before `before` (naive wall time)."""
+        with self._lock:
+            cutoff = slot_of(before)
+            for slot in [s for s in self._busy if s < cutoff]:
+                del self._busy[slot]
+
+    def _mark(self, bit, start, end):
+        first, last = _touched_slots(start, end)
+        busy = self._busy
+        for slot in range(first, last + 1):
+            busy[slot] = busy.get(slot, 0) | bit
+
+    def _unmark(self, resource_id, timeline, start, end):
+        # Edge slots may still be shared with a neighbouring interval.
+        clear = ~(1 << resource_id)
+        busy = self._busy
+        first, last = _touched_slots(start, end)
+        for slot in range(first, last + 1):
+            if slot in busy and timeline.is_free(slot_start(slot), slot_start(slot + 1)):
+                busy[slot] &= clear
+
+    def _drop(self, resource_id):
+        timeline = self._timelines.pop(resource_id, None)
+        if timeline is None:
+            return
+        clear = ~(1 << resource_id)
+        self._loaded &= clear
+        busy = self._busy
+        for start, end in zip(timeline.starts, timeline.ends):
+            first, last = _touched_slots(start, end)
+            for slot in range(first, last + 1):
+                if slot in busy:
+                    busy[slot] &= clear
+
+    # -- allocation --------------------------------------------------------
+
+    def free_members(self, pool, start, end):
+        """Bitmask of pool members with no busy time in [start, end)."""
+        with self._lock:
+            busy = self._busy.get
+            first, last = _touched_slots(start, end)
+            start_aligned = _seconds(start) % _SLOT_SECONDS == 0
+            end_aligned = _seconds(end) % _SLOT_SECONDS == 0
+
+            # Slots fully covered by the request must be completely free.
+            inner_lo = first if start_aligned else first + 1
+            inner_hi = last if end_aligned else last - 1
+            blocked = 0
+            for slot in range(inner_lo, inner_hi + 1):
+                blocked |= busy(slot, 0)
+            # Members without a loaded timeline are never offered.
+            candidates = self._pools.get(pool, 0) & self._loaded & ~blocked
+
+            # A partially covered edge slot may be shared with a neighbouring
+            # booking, so members busy there get an exact timeline check.
+            edge = 0
+            if not start_aligned:
+                edge |= busy(first, 0)
+            if not end_aligned:
+                edge |= busy(last, 0)
+            free = candidates & ~edge
+            for rid in _bits(candidates & edge):
+                if self._timelines[rid].is_free(start, end):
+                    free |= 1 << rid
+            return free
+
+    def best_fit(self, pool, start, end, exclude=0):
+        """Pool member whose free gap around [start, end) is tightest, or None.
+
+        Members whose bit is set in `exclude` are never chosen.
+        """
+        with self._lock:
+            free = self.free_members(pool, start, end) & ~exclude
+            if not free:
+                return None
+            first, last = _touched_slots(start, end)
+            cap = self.slack_cap_slots
+            busy = self._busy.get
+
+            # left[d] / right[d]: members still free d slots before / after the
+            # request. Each step narrows the set by one AND.
+            left, right = [free], [free]
+            for d in range(1, cap + 1):
+                left.append(left[-1] & ~busy(first - d, 0))
+                right.append(right[-1] & ~busy(last + d, 0))
+            left.append(0)
+            right.append(0)
+
+            # Members with exactly `a` slots of free time to the left (a == cap
+            # means "cap or more"), likewise for the right.
+            exact_left = [left[a] & ~left[a + 1] for a in range(cap)] + [left[cap]]
+            exact_right = [right[b] & ~right[b + 1] for b in range(cap)] + [right[cap]]
+
+            for total in range(0, 2 * cap + 1):
+                for a in range(max(0, total - cap), min(total, cap) + 1):
+                    match = exact_left[a] & exact_right[total - a]
+                    if match:
+                        return _lowest_bit(match)
+            return _lowest_bit(free)
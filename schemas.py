@@ -0,0 +1,140 @@
+"""Declared request bodies, compiled into strict one-pass JSON decoders.
+
+A Schema lists the fields of a flat JSON object with their types and is
+compiled, once at import, into a decoder that runs inside `json.loads` as the
+`object_pairs_hook`. Each object is checked while its pairs are still a list,
+and the field values go straight into a namedtuple. No intermediate dict is
+built, and a body is rejected at the first unknown key, duplicate key or value
+of the wrong type.
+
+Types are strict. An int field rejects bools, floats and numeric strings, and
+a bool field rejects 0, 1 and "true". A required str field must also be
+non-empty. An optional field may be absent or null, and either way takes its
+default. Nested objects and arrays never match a field type, so they are
+rejected too.
+
+Size limits are not checked here. The app caps bodies with
+MAX_CONTENT_LENGTH before anything is read.
+"""
+import json
+from collections import namedtuple
+
+_TYPE_NAMES = {str: 'a string', int: 'an integer', bool: 'true or false'}
+
+class SchemaError(ValueError):
+    """A request body that doesn't match its schema."""
+
+class Field:
+    __slots__ = ('name', 'type', 'required', 'default')
+
+    def __init__(self, name, type, required=False, default=None):
+        self.name = name
+        self.type = type
+        self.required = required
+        self.default = default
+
+def _checker(field):
+    kind = field.type
+    message = f'{field.name} must be {_TYPE_NAMES[kind]}'
+    if kind is int:
+        # bool is a subclass of int, so an exact type test is needed.
+        def check(value):
+            if type(value) is not int:
+                raise SchemaError(message)
+    elif field.required and kind is str:
+        def check(value):
+            if type(value) is not str:
+                raise SchemaError(message)
+            if not value:
+                raise SchemaError('Missing required fields')
+    else:
+        def check(value):
+            if type(value) is not kind:
+                raise SchemaError(message)
+    return check
+
+class Schema:
+    """A compiled request schema; decode() returns an instance of `Schema.type`."""
+
+    def __init__(self, name, fields):
+        self.name = name
+        self.fields = tuple(fields)
+        self.type = namedtuple(name, [f.name for f in self.fields])
+        self._index = {f.name: (i, _checker(f), f.required) for i, f in enumerate(self.fields)}
+        self._defaults = [f.default for f in self.fields]
+        self._required = sum(f.required for f in self.fields)
+
+    def extend(self, name, *fields):
+        """A new schema with this one's fields followed by `fields`."""
+        return Schema(name, self.fields + fields)
+
+    def _hook(self, pairs):
+        index = self._index
+        values = list(self._defaults)
+        seen = set()
+        required = 0
+        for key, value in pairs:
+            entry = index.get(key)
+            if entry is None:
+                raise SchemaError(f'Unknown field: {key}')
+            if key in seen:
+                raise SchemaError(f'Duplicate field: {key}')
+            seen.add(key)
+            position, check, is_required = entry
+            if value is None and not is_required:
+                continue
+            if value is None:
+                raise SchemaError('Missing required fields')
+            check(value)
+            values[position] = value
+            required += is_required
+        if required != self._required:
+            raise SchemaError('Missing required fields')
+        return self.type._make(values)
+
+    def decode(self, body):
+        """Decodes a JSON body (bytes or str) into a `self.type` instance.
+
+        Raises SchemaError, with a message fit for the client, if it doesn't match.
+        """
+        try:
+            result = json.loads(body, object_pairs_hook=self._hook)
+        except SchemaError:
+            raise
+        except (ValueError, RecursionError):
+            # Malformed JSON, bad encoding, an integer too long to convert, or
+            # arrays nested deeper than the parser's recursion limit.
+            raise SchemaError('Invalid input') from None
+        if type(result) is not self.type:
+            raise SchemaError('Invalid input')
+        return result
+
+# Request bodies of the reservation API.
+BOOKING = Schema('Booking', [
+    Field('username', str, required=True),
+    Field('start_time', str, required=True),
+    Field('end_time', str, required=True),
+    Field('resource_id', int),
+    Field('pool', str),
+    Field('priority', int, default=0),
+    Field('waitlist', bool, default=False),
+])
+HOLD = BOOKING.extend('Hold', Field('ttl_seconds', int))
+OWNER = Schema('Owner', [Field('username', str, required=True)])
+CHANGE = Schema('Change', [
+    Field('username', str, required=True),
+    Field('start_time', str),
+    Field('end_time', str),
+])
+RESOURCE = Schema('Resource', [
+    Field('name', str, required=True),
+    Field('pool', str),
+])
+BLACKOUT = Schema('Blackout', [
+    Field('start_time', str, required=True),
+    Field('end_time', str, required=True),
+    Field('resource_id', int),
+    Field('recurrence', str),
+    Field('until', str),
+    Field('reason', str),
+])
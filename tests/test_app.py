@@ -1,19 +1,44 @@
 import unittest
+import gzip
 import json
+import os
+import shutil
+import sqlite3
+import subprocess
+import sys
+import tempfile
+import random
+import re
+import time
+from unittest import mock
 from datetime import datetime, timedelta, timezone
 import pytz # Import pytz
-from app import app, db, Reservation, PST, MAX_RESERVATION_DURATION, MIN_RESERVATION_DURATION, ADVANCE_BOOKING_LIMIT
+import compression
+from msgpack import unpackb
+from app import (create_app, db, archive_expired, materialize_blackouts, rebuild_daily_summary, summarize, ArchivedReservation,
+                 DailySummary, Reservation, RoundEntry, UsageLedger, User, expire_holds, fair_order, intern_user,
+                 run_opening_round, week_of, default_resource_id, PST, MAX_RESERVATION_DURATION, MIN_RESERVATION_DURATION,
+                 ADVANCE_BOOKING_LIMIT, reservation_list_response)
+
+REPO_ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+
+# Upper bound for `import app` in a fresh interpreter. Importing must not build
+# an application, open the database or create tables.
+IMPORT_TIME_BUDGET_SECONDS = 2.0
+
+def make_test_app():
+    return create_app({
+        'TESTING': True,
+        'SQLALCHEMY_DATABASE_URI': 'sqlite:///:memory:', # Use in-memory SQLite for tests
+    })
 
 class ReservationTestCase(unittest.TestCase):
     def setUp(self):
-        app.config['TESTING'] = True
-        app.config['SQLALCHEMY_DATABASE_URI'] = 'sqlite:///:memory:' # Use in-memory SQLite for tests
-        self.client = app.test_client()
-        with app.app_context():
-            db.create_all()
+        self.app = make_test_app()
+        self.client = self.app.test_client()
 
     def tearDown(self):
-        with app.app_context():
+        with self.app.app_context():
             db.session.remove()
             db.drop_all()
 
@@ -35,7 +60,7 @@ class ReservationTestCase(unittest.TestCase):
         self.assertEqual(response.status_code, 201)
         data = json.loads(response.data)
         self.assertEqual(data['username'], "testuser")
-        with app.app_context(): # Add app context for DB query
+        with self.app.app_context(): # Add app context for DB query
             self.assertTrue(Reservation.query.count() == 1)
 
     def test_02_get_reservations_empty(self):
@@ -296,5 +321,1089 @@ class ReservationTestCase(unittest.TestCase):
         data = json.loads(response.data)
         self.assertIn("Invalid date format", data['error'])
 
+    def test_15_dst_nonexistent_and_ambiguous_times(self):
+        """Local times skipped or repeated by a DST change are rejected, not shifted."""
+        cases = [
+            ("2025-03-09 02:30", "2025-03-09 03:30", "skipped by the daylight saving change"),
+            ("2025-11-02 01:30", "2025-11-02 03:00", "occurs twice during the daylight saving change"),
+        ]
+        for start, end, message in cases:
+            payload = {"username": "dstuser", "start_time": start, "end_time": end}
+            response = self.client.post('/reservations', json=payload)
+            self.assertEqual(response.status_code, 400)
+            self.assertIn(message, json.loads(response.data)['error'])
+
+    def test_16_response_times_carry_pst_offset(self):
+        """Returned times are ISO 8601 with the PST/PDT offset of that instant."""
+        payload = self._make_reservation("offsetuser", 1, 14, 60)
+        created = json.loads(self.client.post('/reservations', json=payload).data)
+        expected = PST.localize(datetime.strptime(payload['start_time'], '%Y-%m-%d %H:%M:%S')).isoformat()
+        self.assertEqual(created['start_time'], expected)
+        listed = json.loads(self.client.get('/reservations').data)
+        self.assertEqual(listed[0]['start_time'], expected)
+
+    def _create_resource(self, name):
+        response = self.client.post('/resources', json={"name": name})
+        self.assertEqual(response.status_code, 201)
+        return json.loads(response.data)['id']
+
+    def test_17_conflicts_are_scoped_per_resource(self):
+        """The same slot can be booked once on each resource, but not twice on one."""
+        gpu1 = self._create_resource("gpu-1")
+        gpu2 = self._create_resource("gpu-2")
+        payload = self._make_reservation("res_user", 1, 15, 60)
+
+        for resource_id in (gpu1, gpu2):
+            response = self.client.post('/reservations', json=dict(payload, resource_id=resource_id))
+            self.assertEqual(response.status_code, 201)
+            self.assertEqual(json.loads(response.data)['resource_id'], resource_id)
+
+        response = self.client.post('/reservations', json=dict(payload, resource_id=gpu1))
+        self.assertEqual(response.status_code, 409)
+
+        # Without resource_id the booking goes to the default resource, which is still free.
+        self.assertEqual(self.client.post('/reservations', json=payload).status_code, 201)
+
+        listed = json.loads(self.client.get(f'/reservations?resource_id={gpu2}').data)
+        self.assertEqual([r['resource_id'] for r in listed], [gpu2])
+        self.assertEqual(len(json.loads(self.client.get('/reservations').data)), 3)
+
+    def test_18_unknown_resource(self):
+        payload = self._make_reservation("res_user", 1, 15, 60)
+        response = self.client.post('/reservations', json=dict(payload, resource_id=9999))
+        self.assertEqual(response.status_code, 400)
+        self.assertIn("Unknown resource", json.loads(response.data)['error'])
+
+    def test_19_resources_listing_and_duplicates(self):
+        self._create_resource("lab-box")
+        self.assertEqual(self.client.post('/resources', json={"name": "lab-box"}).status_code, 409)
+        self.assertEqual(self.client.post('/resources', json={}).status_code, 400)
+        names = [r['name'] for r in json.loads(self.client.get('/resources').data)]
+        self.assertEqual(names, ["default", "lab-box"])
+
+    def test_20_pool_allocation_best_fit(self):
+        """A pooled booking goes to the free member with the tightest surrounding gap."""
+        ids = [json.loads(self.client.post('/resources', json={"name": f"node-{i}", "pool": "batch"}).data)['id']
+               for i in range(3)]
+        # node-1 is free only 10:00-11:00; node-2 is free 10:00-12:00; node-0 is wide open.
+        for rid, hour, minutes in [(ids[1], 9, 60), (ids[1], 11, 60), (ids[2], 9, 60), (ids[2], 12, 60)]:
+            payload = dict(self._make_reservation(f"setup-{rid}-{hour}", 1, hour, minutes), resource_id=rid)
+            self.assertEqual(self.client.post('/reservations', json=payload).status_code, 201)
+
+        payload = dict(self._make_reservation("pooled", 1, 10, 60), pool="batch")
+        allocated = []
+        for i in range(3):
+            response = self.client.post('/reservations', json=dict(payload, username=f"pooled-{i}"))
+            self.assertEqual(response.status_code, 201)
+            allocated.append(json.loads(response.data)['resource_id'])
+        self.assertEqual(allocated, [ids[1], ids[2], ids[0]])
+
+        response = self.client.post('/reservations', json=payload)
+        self.assertEqual(response.status_code, 409)
+        self.assertIn("No resource in the pool is free", json.loads(response.data)['error'])
+
+    def test_21_pool_request_validation(self):
+        payload = self._make_reservation("pooled", 1, 10, 60)
+        response = self.client.post('/reservations', json=dict(payload, pool="nope"))
+        self.assertEqual(response.status_code, 400)
+        self.assertIn("Unknown resource pool", json.loads(response.data)['error'])
+        response = self.client.post('/reservations', json=dict(payload, pool="nope", resource_id=1))
+        self.assertEqual(response.status_code, 400)
+
+    def test_22_next_available_walks_gaps(self):
+        """Free windows are the first fit in each gap long enough for the duration."""
+        tomorrow = (datetime.now(PST) + timedelta(days=1)).replace(hour=0, minute=0, second=0, microsecond=0, tzinfo=None)
+        fmt = lambda dt: dt.strftime('%Y-%m-%d %H:%M')
+        for start_h, start_m, minutes in [(10, 0, 60), (11, 30, 30)]:
+            start = tomorrow + timedelta(hours=start_h, minutes=start_m)
+            payload = {"username": "busy", "start_time": fmt(start), "end_time": fmt(start + timedelta(minutes=minutes))}
+            self.assertEqual(self.client.post('/reservations', json=payload).status_code, 201)
+
+        after = fmt(tomorrow + timedelta(hours=9, minutes=5))
+        response = self.client.get(f'/availability/next?duration=45m&after={after}&limit=2')
+        self.assertEqual(response.status_code, 200)
+        data = json.loads(response.data)
+        self.assertEqual(data['duration_minutes'], 45)
+        windows = [(w['start_time'][:16], w['end_time'][:16], w['free_until'] and w['free_until'][:16])
+                   for w in data['windows']]
+        # 09:15 (rounded up from 09:05) fits before 10:00; 11:00-11:30 is too short.
+        self.assertEqual(windows, [
+            (fmt(tomorrow + timedelta(hours=9, minutes=15)).replace(' ', 'T'),
+             fmt(tomorrow + timedelta(hours=10)).replace(' ', 'T'),
+             fmt(tomorrow + timedelta(hours=10)).replace(' ', 'T')),
+            (fmt(tomorrow + timedelta(hours=12)).replace(' ', 'T'),
+             fmt(tomorrow + timedelta(hours=12, minutes=45)).replace(' ', 'T'),
+             None),
+        ])
+
+        # Every returned window is bookable as-is.
+        first = data['windows'][0]
+        payload = {"username": "taker", "start_time": first['start_time'][:16].replace('T', ' '),
+                   "end_time": first['end_time'][:16].replace('T', ' ')}
+        self.assertEqual(self.client.post('/reservations', json=payload).status_code, 201)
+
+    def test_23_next_available_validation_and_horizon(self):
+        self.assertEqual(self.client.get('/availability/next').status_code, 400)
+        self.assertEqual(self.client.get('/availability/next?duration=5m').status_code, 400)
+        self.assertEqual(self.client.get('/availability/next?duration=5h').status_code, 400)
+        self.assertEqual(self.client.get('/availability/next?duration=1x').status_code, 400)
+        self.assertEqual(self.client.get('/availability/next?duration=1h&resource_id=999').status_code, 400)
+        self.assertEqual(self.client.get('/availability/next?duration=1h&limit=0').status_code, 400)
+
+        # Nothing is offered beyond the advance booking limit.
+        far = (datetime.now(PST) + ADVANCE_BOOKING_LIMIT + timedelta(days=2)).strftime('%Y-%m-%d %H:%M')
+        data = json.loads(self.client.get(f'/availability/next?duration=90&after={far}').data)
+        self.assertEqual(data['windows'], [])
+
+        # With no bookings, the first window starts at the next slot boundary after now.
+        data = json.loads(self.client.get('/availability/next?duration=1h30m').data)
+        self.assertEqual(len(data['windows']), 1)
+        self.assertIsNone(data['windows'][0]['free_until'])
+
+    @staticmethod
+    def _decode_runs(runs):
+        bits = []
+        for i, count in enumerate(runs):
+            bits.extend([i % 2] * count)
+        return bits
+
+    def test_24_availability_map(self):
+        """Taken, partially taken and past slots are unavailable; runs start with a free run."""
+        tomorrow = (datetime.now(PST) + timedelta(days=1)).replace(hour=0, minute=0, second=0, microsecond=0, tzinfo=None)
+        fmt = lambda dt: dt.strftime('%Y-%m-%d %H:%M')
+        for start, end in [(timedelta(hours=10), timedelta(hours=11)),
+                           (timedelta(hours=13, minutes=5), timedelta(hours=13, minutes=20))]:
+            payload = {"username": "busy", "start_time": fmt(tomorrow + start), "end_time": fmt(tomorrow + end)}
+            self.assertEqual(self.client.post('/reservations', json=payload).status_code, 201)
+
+        day = tomorrow.strftime('%Y-%m-%d')
+        response = self.client.get(f'/availability?from={day}&to={day}')
+        self.assertEqual(response.status_code, 200)
+        data = json.loads(response.data)
+        self.assertEqual(data['slot_minutes'], 15)
+        self.assertEqual(data['slots'], 96)
+        self.assertEqual(data['start'], tomorrow.strftime('%Y-%m-%dT00:00'))
+        bits = self._decode_runs(data['runs'])
+        self.assertEqual(len(bits), 96)
+        taken = [i for i, b in enumerate(bits) if b]
+        # On a DST-change day the skipped or repeated hour is also unavailable.
+        dst_slots = [i for i in range(96) if i not in (40, 41, 42, 43, 52, 53) and bits[i]]
+        self.assertTrue(set(taken) >= {40, 41, 42, 43, 52, 53})
+        self.assertLessEqual(len(dst_slots), 4)
+
+        today = json.loads(self.client.get('/availability').data)
+        now = datetime.now(PST)
+        past_slots = (now.hour * 60 + now.minute) // 15 + 1
+        self.assertTrue(all(self._decode_runs(today['runs'])[:past_slots]))
+        self.assertEqual(today['runs'][0], 0)
+
+    def test_25_availability_validation(self):
+        self.assertEqual(self.client.get('/availability?from=2025-13-01').status_code, 400)
+        self.assertEqual(self.client.get('/availability?from=2025-07-10&to=2025-07-01').status_code, 400)
+        self.assertEqual(self.client.get('/availability?from=2025-01-01&to=2025-03-01').status_code, 400)
+        self.assertEqual(self.client.get('/availability?resource_id=999').status_code, 400)
+        # Beyond the booking horizon nothing is bookable.
+        far = (datetime.now(PST) + ADVANCE_BOOKING_LIMIT + timedelta(days=2)).strftime('%Y-%m-%d')
+        data = json.loads(self.client.get(f'/availability?from={far}').data)
+        self.assertEqual(data['runs'], [0, 96])
+
+    def test_26_conflict_lists_blockers_and_alternatives(self):
+        self.client.post('/reservations', json=self._make_reservation("a", 2, 10, 60))   # 10:00-11:00
+        second = self._make_reservation("b", 2, 11, 60)                                   # 11:30-12:30
+        second['start_time'] = second['start_time'].replace(' 11:00', ' 11:30')
+        second['end_time'] = second['end_time'].replace(' 12:00', ' 12:30')
+        self.assertEqual(self.client.post('/reservations', json=second).status_code, 201)
+
+        request = self._make_reservation("c", 2, 10, 75)
+        request['start_time'] = request['start_time'].replace(' 10:00', ' 10:30')
+        request['end_time'] = request['end_time'].replace(' 11:15', ' 11:45')
+        response = self.client.post('/reservations', json=request)
+        self.assertEqual(response.status_code, 409)
+        data = json.loads(response.data)
+        self.assertIn("overlaps with an existing reservation", data['error'])
+        self.assertEqual(data['conflict_count'], 2)
+        self.assertEqual([c['username'] for c in data['conflicts']], ["a", "b"])
+        day = request['start_time'][:10]
+        self.assertTrue(data['alternatives']['earlier']['start_time'].startswith(f'{day}T08:45:00'))
+        self.assertTrue(data['alternatives']['earlier']['end_time'].startswith(f'{day}T10:00:00'))
+        self.assertTrue(data['alternatives']['later']['start_time'].startswith(f'{day}T12:30:00'))
+        self.assertTrue(data['alternatives']['later']['end_time'].startswith(f'{day}T13:45:00'))
+
+        # Alternatives are bookable as returned.
+        later = data['alternatives']['later']
+        rebook = dict(request, start_time=later['start_time'][:19], end_time=later['end_time'][:19])
+        self.assertEqual(self.client.post('/reservations', json=rebook).status_code, 201)
+
+    def test_27_conflict_alternatives_stay_in_the_future(self):
+        # An earlier window of the same length would have to start in the past.
+        start = (datetime.now(PST) + timedelta(minutes=30)).replace(second=0, microsecond=0)
+        payload = {"username": "a", "start_time": start.strftime('%Y-%m-%d %H:%M'),
+                   "end_time": (start + timedelta(minutes=30)).strftime('%Y-%m-%d %H:%M')}
+        if self.client.post('/reservations', json=payload).status_code != 201:
+            self.skipTest("slot near now is not bookable (DST change)")
+        data = json.loads(self.client.post('/reservations', json=payload).data)
+        self.assertIsNone(data['alternatives']['earlier'])
+        self.assertIsNotNone(data['alternatives']['later'])
+
+    def test_28_archive_and_history(self):
+        now = datetime.now(PST).replace(tzinfo=None, microsecond=0)
+        with self.app.app_context():
+            for username, days_ago in [("old1", 45), ("old2", 40), ("recent", 2)]:
+                start = now - timedelta(days=days_ago)
+                db.session.add(Reservation(resource_id=1, user_id=intern_user(username), start_time=start,
+                                           end_time=start + timedelta(hours=1)))
+            db.session.commit()
+        self.client.post('/reservations', json=self._make_reservation("future", 1, 10, 60))
+
+        with self.app.app_context():
+            self.assertEqual(archive_expired(now, timedelta(days=30), batch_size=1), 2)
+            self.assertEqual(archive_expired(now, timedelta(days=30), batch_size=1), 0)
+            self.assertEqual(sorted(r.user.name for r in ArchivedReservation.query), ["old1", "old2"])
+            self.assertEqual(sorted(r.user.name for r in Reservation.query), ["future", "recent"])
+
+        history = json.loads(self.client.get('/reservations?view=history').data)
+        self.assertEqual([r['username'] for r in history], ["recent", "old2", "old1"])
+        page = json.loads(self.client.get('/reservations?view=history&limit=1').data)
+        self.assertEqual([r['username'] for r in page], ["recent"])
+        before = history[1]['start_time'][:19]
+        page = json.loads(self.client.get(f'/reservations?view=history&before={before}').data)
+        self.assertEqual([r['username'] for r in page], ["old1"])
+        self.assertEqual([r['username'] for r in json.loads(self.client.get('/reservations').data)], ["future"])
+        self.assertEqual(self.client.get('/reservations?view=history&limit=0').status_code, 400)
+        self.assertEqual(self.client.get('/reservations?view=history&before=yesterday').status_code, 400)
+
+    def test_29_archive_cli(self):
+        start = datetime.now(PST).replace(tzinfo=None, microsecond=0) - timedelta(days=60)
+        with self.app.app_context():
+            db.session.add(Reservation(resource_id=1, user_id=intern_user("old"), start_time=start,
+                                       end_time=start + timedelta(hours=1)))
+            db.session.commit()
+        result = self.app.test_cli_runner().invoke(args=['archive'])
+        self.assertIn('Archived 1 reservations', result.output)
+
+    def _summary(self, day):
+        return {row['resource_id']: row for row in json.loads(self.client.get(f'/summary?from={day}').data)}
+
+    def test_30_daily_summary_follows_bookings(self):
+        first = self._make_reservation("a", 2, 10, 60)
+        self.client.post('/reservations', json=first)
+        self.client.post('/reservations', json=self._make_reservation("b", 2, 13, 90))
+        overnight = self._make_reservation("c", 3, 22, 180)
+        self.client.post('/reservations', json=overnight)
+
+        day2, day3 = first['start_time'][:10], overnight['start_time'][:10]
+        row = self._summary(day2)[1]
+        self.assertEqual((row['booked_minutes'], row['reservation_count']), (150, 2))
+        self.assertTrue(row['first_start'].startswith(f'{day2}T10:00:00'))
+        self.assertTrue(row['last_end'].startswith(f'{day2}T14:30:00'))
+        rows = json.loads(self.client.get(f'/summary?from={day3}&to={overnight["end_time"][:10]}&resource_id=1').data)
+        self.assertEqual([(r['booked_minutes'], r['reservation_count']) for r in rows], [(120, 1), (60, 1)])
+        self.assertEqual(self._summary(overnight['end_time'][:10])[1]['first_start'][11:19], '00:00:00')
+
+        with self.app.app_context():
+            maintained = sorted((r.resource_id, r.day, r.booked_minutes, r.reservation_count, r.first_start, r.last_end)
+                                for r in DailySummary.query)
+            rebuild_daily_summary()
+            rebuilt = sorted((r.resource_id, r.day, r.booked_minutes, r.reservation_count, r.first_start, r.last_end)
+                             for r in DailySummary.query)
+            self.assertEqual(maintained, rebuilt)
+
+            # Removing the day's first booking moves first_start to the next one.
+            reservation = Reservation.query.join(User).filter(User.name == "a").one()
+            db.session.delete(reservation)
+            summarize(1, reservation.start_time, reservation.end_time, added=False)
+            db.session.commit()
+        row = self._summary(day2)[1]
+        self.assertEqual((row['booked_minutes'], row['reservation_count']), (90, 1))
+        self.assertTrue(row['first_start'].startswith(f'{day2}T13:00:00'))
+
+    def test_32_analytics(self):
+        a1 = self._make_reservation("alice", 2, 10, 120)
+        day = a1['start_time'][:10]
+        self.client.post('/reservations', json=a1)
+        self.client.post('/reservations', json=self._make_reservation("bob", 2, 13, 60))
+        self.client.post('/reservations', json=self._make_reservation("alice", 2, 15, 60))
+        self.assertEqual(self.client.post('/reservations', json=self._make_reservation("carol", 2, 10, 30)).status_code, 409)
+
+        data = json.loads(self.client.get(f'/analytics?from={day}&to={day}').data)
+        self.assertEqual(data['resources'], 1)
+        self.assertEqual(data['daily'][0]['booked_minutes'], 240)
+        self.assertAlmostEqual(data['daily'][0]['utilization'], round(240 / 1440, 4))
+        weekday = datetime.strptime(day, '%Y-%m-%d').weekday()
+        self.assertEqual(data['hour_of_week'][weekday][10], 1.0)
+        self.assertEqual(data['hour_of_week'][weekday][12], 0.0)
+        self.assertEqual(data['top_users'], [{"username": "alice", "booked_hours": 3.0, "reservations": 2},
+                                             {"username": "bob", "booked_hours": 1.0, "reservations": 1}])
+        self.assertEqual(data['bookings'], {"created": 3, "conflicts": 1, "rejection_rate": 0.25})
+
+        # A resource with nothing booked, and the validation errors.
+        rid = json.loads(self.client.post('/resources', json={"name": "idle"}).data)['id']
+        idle = json.loads(self.client.get(f'/analytics?from={day}&to={day}&resource_id={rid}&top=1').data)
+        self.assertEqual((idle['top_users'], idle['bookings']['created'], idle['daily'][0]['utilization']), ([], 0, 0.0))
+        self.assertEqual(len(json.loads(self.client.get('/analytics').data)['daily']), ADVANCE_BOOKING_LIMIT.days)
+        self.assertEqual(self.client.get('/analytics?from=2024-01-01&to=2025-07-01').status_code, 400)
+        self.assertEqual(self.client.get('/analytics?top=0').status_code, 400)
+        self.assertEqual(self.client.get('/analytics?to=tomorrow').status_code, 400)
+
+    def test_33_weekly_hours_quota(self):
+        self.app.config['QUOTA_ACTIVE_RESERVATIONS'] = None
+        # 10h per week: 4h + 4h + 2h fits, the next 15 minutes do not.
+        day = next(d for d in range(1, 8) if (datetime.now(PST) + timedelta(days=d)).weekday() < 4)
+        for hour, minutes in [(6, 240), (11, 240), (16, 120)]:
+            self.assertEqual(self.client.post('/reservations', json=self._make_reservation("heavy", day, hour, minutes)).status_code, 201)
+        response = self.client.post('/reservations', json=self._make_reservation("heavy", day + 1, 10, 15))
+        self.assertEqual(response.status_code, 403)
+        self.assertIn("Weekly quota of 10 hours exceeded", json.loads(response.data)['error'])
+        # Other users and other weeks are unaffected.
+        self.assertEqual(self.client.post('/reservations', json=self._make_reservation("light", day + 1, 10, 15)).status_code, 201)
+        self.assertEqual(self.client.post('/reservations', json=self._make_reservation("heavy", day + 7, 10, 60)).status_code, 201)
+
+        with self.app.app_context():
+            entry = db.session.get(UsageLedger, (intern_user("heavy"), week_of(datetime.now(PST).replace(tzinfo=None) + timedelta(days=day))))
+            self.assertEqual((entry.booked_minutes, entry.reservation_count), (600, 3))
+
+    def test_34_active_reservation_quota(self):
+        for day in range(1, 4):
+            self.assertEqual(self.client.post('/reservations', json=self._make_reservation("busy", day, 10, 30)).status_code, 201)
+        response = self.client.post('/reservations', json=self._make_reservation("busy", 4, 10, 30))
+        self.assertEqual(response.status_code, 403)
+        self.assertIn("At most 3 active reservations", json.loads(response.data)['error'])
+        # Reservations that have ended no longer count.
+        with self.app.app_context():
+            past = datetime.now(PST).replace(tzinfo=None) - timedelta(days=1)
+            Reservation.query.join(User).filter(User.name == "busy").first().end_time = past
+            db.session.commit()
+        self.assertEqual(self.client.post('/reservations', json=self._make_reservation("busy", 4, 10, 30)).status_code, 201)
+
+    def test_35_users_are_interned_and_listed(self):
+        for day, user in [(1, "dana"), (2, "erin"), (3, "dana")]:
+            self.assertEqual(self.client.post('/reservations', json=self._make_reservation(user, day, 10, 30)).status_code, 201)
+        with self.app.app_context():
+            self.assertEqual(sorted(u.name for u in User.query), ["dana", "erin"])
+            self.assertEqual(len({r.user_id for r in Reservation.query}), 2)
+
+        mine = json.loads(self.client.get('/users/dana/reservations').data)
+        self.assertEqual([r['username'] for r in mine], ["dana", "dana"])
+        self.assertLess(mine[0]['start_time'], mine[1]['start_time'])
+        self.assertEqual(json.loads(self.client.get('/users/nobody/reservations').data), [])
+
+    def test_36_hold_blocks_until_confirmed(self):
+        payload = self._make_reservation("alice", 1, 10, 60)
+        response = self.client.post('/reservations/hold', json=dict(payload, ttl_seconds=60))
+        self.assertEqual(response.status_code, 201)
+        hold = json.loads(response.data)
+        self.assertTrue(hold['hold_expires_at'].endswith('Z'))
+        self.assertIn(hold['id'], self.app.extensions['hold_wheel'].advance(time.time() + 120))
+
+        # Conflict checks and availability see the hold.
+        response = self.client.post('/reservations', json=dict(payload, username="bob"))
+        self.assertEqual(response.status_code, 409)
+        self.assertEqual(json.loads(response.data)['conflicts'][0]['id'], hold['id'])
+
+        self.assertEqual(self.client.post(f"/reservations/{hold['id']}/confirm", json={"username": "bob"}).status_code, 403)
+        response = self.client.post(f"/reservations/{hold['id']}/confirm", json={"username": "alice"})
+        self.assertEqual(response.status_code, 200)
+        self.assertNotIn('hold_expires_at', json.loads(response.data))
+        self.assertEqual(self.client.post(f"/reservations/{hold['id']}/confirm", json={"username": "alice"}).status_code, 404)
+        # A confirmed booking is not released by a late expiry.
+        with self.app.app_context():
+            self.assertEqual(expire_holds([hold['id']]), 0)
+        self.assertEqual(len(json.loads(self.client.get('/reservations').data)), 1)
+
+    def test_37_expired_hold_is_released(self):
+        payload = self._make_reservation("alice", 1, 10, 60)
+        hold = json.loads(self.client.post('/reservations/hold', json=payload).data)
+        with self.app.app_context():
+            db.session.get(Reservation, hold['id']).hold_expires_at = datetime.now(timezone.utc).replace(tzinfo=None) - timedelta(seconds=1)
+            db.session.commit()
+        self.assertEqual(self.client.post(f"/reservations/{hold['id']}/confirm", json={"username": "alice"}).status_code, 410)
+        # An expired hold stops blocking and being listed at once, before the sweeper gets to it.
+        self.assertEqual(json.loads(self.client.get('/reservations').data), [])
+        self.assertEqual(json.loads(self.client.get('/users/alice/reservations').data), [])
+        self.assertEqual(self.client.post('/reservations', json=dict(payload, username="bob")).status_code, 201)
+
+        # The booking released the hold it replaced, so neither is counted twice.
+        with self.app.app_context():
+            self.assertEqual([r.user.name for r in Reservation.query.all()], ["bob"])
+            self.assertEqual(DailySummary.query.one().reservation_count, 1)
+            alice = db.session.get(UsageLedger, (intern_user("alice"), week_of(datetime.strptime(payload['start_time'], '%Y-%m-%d %H:%M:%S'))))
+            self.assertEqual(alice.booked_minutes, 0)
+        self.assertEqual([r['username'] for r in json.loads(self.client.get('/reservations').data)], ["bob"])
+
+        # A hold nothing replaced is left to the sweeper.
+        other = json.loads(self.client.post('/reservations/hold', json=self._make_reservation("alice", 1, 14, 60)).data)
+        with self.app.app_context():
+            db.session.get(Reservation, other['id']).hold_expires_at = datetime.now(timezone.utc).replace(tzinfo=None) - timedelta(seconds=1)
+            db.session.commit()
+            self.assertEqual(expire_holds([other['id']]), 1)
+            self.assertEqual(Reservation.query.count(), 1)
+
+    def test_38_release_and_validate_holds(self):
+        payload = self._make_reservation("alice", 1, 10, 60)
+        hold = json.loads(self.client.post('/reservations/hold', json=payload).data)
+        self.assertEqual(self.client.delete(f"/reservations/{hold['id']}/hold", json={"username": "bob"}).status_code, 403)
+        self.assertEqual(self.client.delete(f"/reservations/{hold['id']}/hold", json={"username": "alice"}).status_code, 200)
+        self.assertEqual(self.client.delete(f"/reservations/{hold['id']}/hold", json={"username": "alice"}).status_code, 404)
+        self.assertEqual(self.client.post('/reservations', json=dict(payload, username="bob")).status_code, 201)
+        for ttl in [0, 601, "60", True]:
+            self.assertEqual(self.client.post('/reservations/hold', json=dict(payload, ttl_seconds=ttl)).status_code, 400)
+
+    def test_39_opening_round_is_fair(self):
+        entries = [RoundEntry(id=i, user_id=user) for i, user in enumerate([1, 1, 1, 2, 3])]
+        for seed in range(5):
+            ordered = fair_order(entries, 'round_robin', random.Random(seed))
+            # Every user's first request comes before anyone's second.
+            self.assertEqual(sorted(e.user_id for e in ordered[:3]), [1, 2, 3])
+            self.assertEqual([e.id for e in ordered if e.user_id == 1], [0, 1, 2])
+            self.assertEqual(sorted(e.id for e in fair_order(entries, 'lottery', random.Random(seed))), list(range(5)))
+
+        day = (datetime.now(PST) + ADVANCE_BOOKING_LIMIT).replace(tzinfo=None, hour=0, minute=0, second=0, microsecond=0)
+        with self.app.app_context():
+            alice, bob = intern_user("alice"), intern_user("bob")
+            for user_id, hour in [(alice, 10), (alice, 11), (bob, 10)]:
+                db.session.add(RoundEntry(day=day.date(), user_id=user_id, resource_id=1,
+                                          start_time=day.replace(hour=hour), end_time=day.replace(hour=hour + 1)))
+            db.session.commit()
+            self.assertEqual(run_opening_round(day.date(), 'round_robin', random.Random(1)), 3)
+            self.assertEqual(run_opening_round(day.date(), 'round_robin'), 0)
+            codes = sorted(e.status_code for e in RoundEntry.query)
+            self.assertEqual(codes, [201, 201, 409])
+            rejected = RoundEntry.query.filter_by(status='rejected').one()
+            self.assertEqual(json.loads(rejected.response)['conflicts'][0]['start_time'][:16],
+                             day.replace(hour=10).strftime('%Y-%m-%dT%H:%M'))
+            self.assertEqual(Reservation.query.count(), 2)
+
+    def test_40_opening_round_request_path(self):
+        self.app.config['OPENING_ROUND_SECONDS'] = 0.2
+        midnight = PST.localize(datetime.combine(datetime.now(PST).date(), datetime.min.time()))
+        opened = midnight.replace(tzinfo=None) + ADVANCE_BOOKING_LIMIT
+        def booking(username, day):
+            return {"username": username,
+                    "start_time": day.replace(hour=10).strftime('%Y-%m-%d %H:%M'),
+                    "end_time": day.replace(hour=11).strftime('%Y-%m-%d %H:%M')}
+        with mock.patch('app.now_pst', return_value=midnight + timedelta(seconds=0.1)):
+            # Requests for the new day are queued, not answered in arrival order.
+            queued = [self.client.post('/reservations', json=booking(name, opened)) for name in ("alice", "bob")]
+            for response in queued:
+                self.assertEqual(response.status_code, 202)
+                self.assertEqual(response.headers['Retry-After'], '1')
+                self.assertEqual(json.loads(response.data)['opening_round']['status_url'], response.headers['Location'])
+            self.assertEqual(self.client.get(queued[0].headers['Location']).status_code, 202)
+            # Other days are booked at once, outside the round.
+            self.assertEqual(self.client.post('/reservations', json=booking("bob", opened - timedelta(days=1))).status_code, 201)
+        with mock.patch('app.now_pst', return_value=midnight + timedelta(seconds=1)):
+            # The first poll after the round closes runs it.
+            outcomes = [self.client.get(response.headers['Location']) for response in queued]
+        self.assertEqual(sorted(r.status_code for r in outcomes), [201, 409])
+        self.assertEqual(self.client.get(queued[0].headers['Location']).status_code, outcomes[0].status_code)
+        self.assertEqual(self.client.get('/opening-round/999').status_code, 404)
+        with self.app.app_context():
+            self.assertEqual(RoundEntry.query.count(), 2)
+            self.assertEqual(Reservation.query.count(), 2)
+
+    def test_41_waitlist_promoted_when_interval_frees(self):
+        payload = self._make_reservation("alice", 1, 10, 60)
+        hold = json.loads(self.client.post('/reservations/hold', json=payload).data)
+        response = self.client.post('/reservations', json=dict(payload, username="bob", waitlist=True))
+        self.assertEqual(response.status_code, 202)
+        body = json.loads(response.data)
+        self.assertEqual(body['conflicts'][0]['id'], hold['id'])
+        self.assertEqual(body['waitlist']['username'], "bob")
+        later = self._make_reservation("carol", 1, 10, 30)
+        self.assertEqual(self.client.post('/reservations', json=dict(later, waitlist=True)).status_code, 202)
+        self.assertEqual(len(json.loads(self.client.get('/users/bob/waitlist').data)), 1)
+
+        # Releasing the hold books the oldest waiter that fits; carol keeps waiting.
+        self.assertEqual(self.client.delete(f"/reservations/{hold['id']}/hold", json={"username": "alice"}).status_code, 200)
+        self.assertEqual([r['username'] for r in json.loads(self.client.get('/reservations').data)], ["bob"])
+        self.assertEqual(json.loads(self.client.get('/users/bob/waitlist').data), [])
+        carol = json.loads(self.client.get('/users/carol/waitlist').data)
+        self.assertEqual(len(carol), 1)
+        promoted = json.loads(self.client.get('/reservations').data)[0]
+        notices = json.loads(self.client.get('/users/bob/notifications').data)
+        self.assertEqual([n['reservation_id'] for n in notices], [promoted['id']])
+        self.assertEqual(json.loads(self.client.get('/users/carol/notifications').data), [])
+        with self.app.app_context():
+            self.assertEqual(DailySummary.query.one().reservation_count, 1)
+
+        self.assertEqual(self.client.delete(f"/waitlist/{carol[0]['id']}", json={"username": "bob"}).status_code, 403)
+        self.assertEqual(self.client.delete(f"/waitlist/{carol[0]['id']}", json={"username": "carol"}).status_code, 200)
+        self.assertEqual(self.client.delete(f"/waitlist/{carol[0]['id']}", json={"username": "carol"}).status_code, 404)
+        for extra in [{"waitlist": "yes"}, {"waitlist": True, "pool": "gpu"}]:
+            self.assertEqual(self.client.post('/reservations', json=dict(payload, **extra)).status_code, 400)
+
+    def test_42_cancel_and_end_now(self):
+        payload = self._make_reservation("alice", 1, 10, 120)
+        booking = json.loads(self.client.post('/reservations', json=payload).data)
+        later = self._make_reservation("alice", 1, 14, 60)
+        cancelled = json.loads(self.client.post('/reservations', json=later).data)
+        waiting = self._make_reservation("bob", 1, 11, 60)
+        self.assertEqual(self.client.post('/reservations', json=dict(waiting, waitlist=True)).status_code, 202)
+
+        self.assertEqual(self.client.delete(f"/reservations/{cancelled['id']}", json={"username": "bob"}).status_code, 403)
+        self.assertEqual(self.client.delete(f"/reservations/{cancelled['id']}", json={"username": "alice"}).status_code, 200)
+        self.assertEqual(self.client.delete(f"/reservations/{cancelled['id']}", json={"username": "alice"}).status_code, 404)
+        self.assertEqual(self.client.post(f"/reservations/{booking['id']}/end", json={"username": "alice"}).status_code, 409)
+
+        start = datetime.strptime(payload['start_time'], '%Y-%m-%d %H:%M:%S')
+        with mock.patch('app.now_pst', return_value=PST.localize(start + timedelta(minutes=30))):
+            self.assertEqual(self.client.delete(f"/reservations/{booking['id']}", json={"username": "alice"}).status_code, 409)
+            response = self.client.post(f"/reservations/{booking['id']}/end", json={"username": "alice"})
+            self.assertEqual(response.status_code, 200)
+            self.assertEqual(json.loads(response.data)['end_time'][11:16], "10:30")
+
+        # The freed time went to the waitlist at once; summaries and the ledger follow.
+        self.assertEqual([r['username'] for r in json.loads(self.client.get('/reservations').data)], ["alice", "bob"])
+        with self.app.app_context():
+            summary = DailySummary.query.one()
+            self.assertEqual((summary.booked_minutes, summary.reservation_count), (90, 2))
+            self.assertEqual(summary.last_end, start + timedelta(hours=2))
+            alice = db.session.get(UsageLedger, (intern_user("alice"), week_of(start)))
+            self.assertEqual((alice.booked_minutes, alice.reservation_count), (30, 1))
+        self.assertEqual(self.client.post('/reservations', json=self._make_reservation("carol", 1, 14, 60)).status_code, 201)
+
+    def test_43_modify_reservation(self):
+        payload = self._make_reservation("alice", 1, 10, 60)
+        booking = json.loads(self.client.post('/reservations', json=payload).data)
+        self.client.post('/reservations', json=self._make_reservation("bob", 1, 12, 60))
+        start = datetime.strptime(payload['start_time'], '%Y-%m-%d %H:%M:%S')
+        def at(hour, minute=0):
+            return (start.replace(hour=hour, minute=minute)).strftime('%Y-%m-%d %H:%M')
+        url, alice = f"/reservations/{booking['id']}", {"username": "alice"}
+
+        # Extending up to bob's booking only checks 11:00-12:00, never alice's own hour.
+        response = self.client.patch(url, json=dict(alice, end_time=at(12)))
+        self.assertEqual(response.status_code, 200)
+        self.assertEqual(json.loads(response.data)['end_time'][11:16], "12:00")
+        response = self.client.patch(url, json=dict(alice, end_time=at(12, 30)))
+        self.assertEqual(response.status_code, 409)
+        self.assertEqual(json.loads(response.data)['conflicts'][0]['username'], "bob")
+        self.assertEqual(self.client.patch(url, json=dict(alice, start_time=at(7))).status_code, 400)
+        self.assertEqual(self.client.patch(url, json=dict(alice, end_time=at(11), username="bob")).status_code, 403)
+        self.assertEqual(self.client.patch(url, json=alice).status_code, 400)
+
+        # Moving away frees the old interval for the waitlist.
+        self.client.post('/reservations', json=dict(self._make_reservation("carol", 1, 10, 60), waitlist=True))
+        response = self.client.patch(url, json=dict(alice, start_time=at(14), end_time=at(15)))
+        self.assertEqual(response.status_code, 200)
+        self.assertEqual(json.loads(response.data)['id'], booking['id'])
+        self.assertEqual([r['username'] for r in json.loads(self.client.get('/reservations').data)], ["carol", "bob", "alice"])
+        with self.app.app_context():
+            summary = DailySummary.query.one()
+            self.assertEqual((summary.booked_minutes, summary.reservation_count), (180, 3))
+            self.assertEqual(summary.last_end, start.replace(hour=15))
+            ledger = db.session.get(UsageLedger, (intern_user("alice"), week_of(start)))
+            self.assertEqual((ledger.booked_minutes, ledger.reservation_count), (60, 1))
+
+        with mock.patch('app.now_pst', return_value=PST.localize(start.replace(hour=14, minute=30))):
+            self.assertEqual(self.client.patch(url, json=dict(alice, start_time=at(14, 15))).status_code, 409)
+            self.assertEqual(self.client.patch(url, json=dict(alice, end_time=at(16))).status_code, 200)
+
+    def test_44_blackouts(self):
+        tomorrow = (datetime.now(PST) + timedelta(days=1)).replace(tzinfo=None, hour=0, minute=0, second=0, microsecond=0)
+        blocked = self._make_reservation("alice", 1, 12, 60)
+        self.assertEqual(self.client.post('/reservations', json=self._make_reservation("alice", 2, 10, 60)).status_code, 201)
+        body = {"start_time": tomorrow.replace(hour=9).strftime('%Y-%m-%d %H:%M'),
+                "end_time": tomorrow.replace(hour=15).strftime('%Y-%m-%d %H:%M'),
+                "recurrence": "daily", "reason": "patching"}
+        response = self.client.post('/blackouts', json=body)
+        self.assertEqual(response.status_code, 409)
+        self.assertEqual(json.loads(response.data)['conflict_count'], 1)
+        response = self.client.post('/blackouts', json=dict(body, recurrence="weekly"))
+        self.assertEqual(response.status_code, 201)
+        blackout = json.loads(response.data)
+
+        # Six hours a week for the horizon, stored in pieces no longer than a reservation.
+        with self.app.app_context():
+            pieces = Reservation.query.filter_by(blackout_id=blackout['id']).order_by(Reservation.start_time).all()
+            self.assertEqual(len(pieces), 10)
+            self.assertTrue(all(p.end_time - p.start_time <= MAX_RESERVATION_DURATION for p in pieces))
+            self.assertIsNone(DailySummary.query.filter_by(day=tomorrow.date()).first())
+            materialize_blackouts(datetime.now(PST).replace(tzinfo=None) + timedelta(days=7))
+            self.assertEqual(Reservation.query.filter_by(blackout_id=blackout['id']).count(), 12)
+            piece_id = pieces[0].id
+
+        response = self.client.post('/reservations', json=blocked)
+        self.assertEqual(response.status_code, 409)
+        self.assertEqual(json.loads(response.data)['conflicts'][0]['blackout_id'], blackout['id'])
+        availability = json.loads(self.client.get(f"/availability?from={tomorrow.strftime('%Y-%m-%d')}").data)
+        self.assertEqual([(w['start_time'][11:16], w['end_time'][11:16], w['reason']) for w in availability['blackouts']],
+                         [("09:00", "15:00", "patching")])
+        self.assertEqual(self.client.delete(f"/reservations/{piece_id}", json={"username": "maintenance"}).status_code, 404)
+        self.assertEqual(self.client.post('/reservations', json=dict(blocked, username="maintenance")).status_code, 400)
+        self.assertEqual(self.client.post('/blackouts', json=dict(body, end_time=body['start_time'])).status_code, 400)
+        self.assertEqual(len(json.loads(self.client.get('/blackouts').data)), 1)
+
+        self.assertEqual(self.client.delete(f"/blackouts/{blackout['id']}").status_code, 200)
+        self.assertEqual(self.client.post('/reservations', json=blocked).status_code, 201)
+        with self.app.app_context():
+            self.assertEqual(Reservation.query.count(), 2)
+
+    def test_45_priority_booking_displaces_lower_priority(self):
+        alice = json.loads(self.client.post('/reservations', json=self._make_reservation("alice", 1, 10, 60)).data)
+        bob = json.loads(self.client.post('/reservations', json=self._make_reservation("bob", 1, 11, 60)).data)
+        request = self._make_reservation("carol", 1, 10, 90)
+        request['start_time'] = request['start_time'].replace('10:00', '10:30')
+        request['end_time'] = request['end_time'].replace('11:30', '12:00')
+        self.assertEqual(self.client.post('/reservations', json=request).status_code, 409)
+        for priority in [3, -1, "1", True]:
+            self.assertEqual(self.client.post('/reservations', json=dict(request, priority=priority)).status_code, 400)
+
+        # Without a configured token, or without the right one, nobody can preempt.
+        token = {'X-Priority-Token': 'ops-secret'}
+        self.assertEqual(self.client.post('/reservations', json=dict(request, priority=1), headers=token).status_code, 403)
+        self.app.config['PRIORITY_TOKEN'] = 'ops-secret'
+        for headers in [{}, {'X-Priority-Token': 'guess'}]:
+            self.assertEqual(self.client.post('/reservations', json=dict(request, priority=1), headers=headers).status_code, 403)
+        self.assertEqual(self.client.post('/reservations/hold', json=dict(request, priority=1)).status_code, 403)
+        self.assertEqual({r['username'] for r in json.loads(self.client.get('/reservations').data)}, {"alice", "bob"})
+
+        response = self.client.post('/reservations', json=dict(request, priority=1), headers=token)
+        self.assertEqual(response.status_code, 201)
+        self.assertEqual(json.loads(response.data)['priority'], 1)
+        # Each displaced booking moves to the nearest free hour around the priority booking.
+        listed = {r['username']: (r['id'], r['start_time'][11:16], r['end_time'][11:16])
+                  for r in json.loads(self.client.get('/reservations').data)}
+        self.assertEqual(listed, {"alice": (alice['id'], "09:30", "10:30"),
+                                  "carol": (listed['carol'][0], "10:30", "12:00"),
+                                  "bob": (bob['id'], "12:00", "13:00")})
+        notes = json.loads(self.client.get('/users/bob/notifications').data)
+        self.assertEqual(len(notes), 1)
+        self.assertEqual(notes[0]['reservation_id'], bob['id'])
+        self.assertIn("moved", notes[0]['message'])
+        with self.app.app_context():
+            self.assertEqual(DailySummary.query.one().booked_minutes, 210)
+
+        # Equal priority, or more bookings than PREEMPT_MAX_DISPLACED, is a plain conflict.
+        self.assertEqual(self.client.post('/reservations', json=dict(request, username="dave", priority=1),
+                                          headers=token).status_code, 409)
+        self.app.config['PREEMPT_MAX_DISPLACED'] = 1
+        wide = self._make_reservation("dave", 1, 9, 240)
+        self.assertEqual(self.client.post('/reservations', json=dict(wide, priority=2), headers=token).status_code, 409)
+
+    def test_46_request_bodies_are_strictly_decoded(self):
+        payload = self._make_reservation("strict", 1, 10, 60)
+        for bad in [dict(payload, extra=1), dict(payload, resource_id="1"), dict(payload, resource_id=1.0),
+                    dict(payload, username={"name": "strict"}), dict(payload, pool=["gpu"]), [payload]]:
+            response = self.client.post('/reservations', json=bad)
+            self.assertEqual(response.status_code, 400, bad)
+        response = self.client.post('/reservations', data='{"username": "a", "username": "b"}',
+                                    content_type='application/json')
+        self.assertIn("Duplicate field", json.loads(response.data)['error'])
+        self.assertEqual(self.client.post('/reservations', data='{"username":', content_type='application/json').status_code, 400)
+        self.assertEqual(self.client.post('/reservations', data=json.dumps(payload), content_type='text/plain').status_code, 415)
+
+        self.app.config['MAX_CONTENT_LENGTH'] = 256
+        response = self.client.post('/reservations', json=dict(payload, username="x" * 300))
+        self.assertEqual(response.status_code, 413)
+        self.assertIn("256 bytes", json.loads(response.data)['error'])
+        # Null optional fields take their defaults.
+        response = self.client.post('/reservations', json=dict(payload, resource_id=None, priority=None))
+        self.assertEqual(response.status_code, 201)
+        booking = json.loads(response.data)
+        self.assertEqual(self.client.delete(f"/reservations/{booking['id']}", json={"username": "strict", "id": 1}).status_code, 400)
+        self.assertEqual(self.client.delete(f"/reservations/{booking['id']}", json={"username": "strict"}).status_code, 200)
+
+        # Resource, blackout and waitlist bodies are declared too.
+        for bad in [{"name": "box", "pool": 1}, {"name": True}, {"name": "box", "extra": 1}]:
+            self.assertEqual(self.client.post('/resources', json=bad).status_code, 400, bad)
+        window = {"start_time": payload['start_time'], "end_time": payload['end_time']}
+        for bad in [dict(window, resource_id=True), dict(window, resource_id="1"), dict(window, reason=5),
+                    dict(window, owner="ops"), {"start_time": payload['start_time']}]:
+            self.assertEqual(self.client.post('/blackouts', json=bad).status_code, 400, bad)
+        self.assertEqual(self.client.post('/blackouts', data=json.dumps(window), content_type='text/plain').status_code, 415)
+        self.assertEqual(self.client.delete('/waitlist/1', data='{"username": "strict"}').status_code, 415)
+        self.assertEqual(self.client.delete('/waitlist/1', json={"username": "strict", "id": 1}).status_code, 400)
+
+    def test_47_msgpack_negotiation(self):
+        packed = {'Accept': 'application/msgpack'}
+        payload = self._make_reservation("packer", 1, 10, 60)
+        response = self.client.post('/reservations', json=payload, headers=packed)
+        self.assertEqual((response.status_code, response.mimetype), (201, 'application/msgpack'))
+        self.assertIn('Accept', response.headers['Vary'])
+        created = unpackb(response.data)
+        start = PST.localize(datetime.strptime(payload['start_time'], '%Y-%m-%d %H:%M:%S'))
+        self.assertEqual(created['start_time'], int(start.timestamp()))
+        self.assertEqual(created['end_time'] - created['start_time'], 3600)
+        self.assertEqual((created['username'], created['priority'], created['hold_expires_at']), ("packer", 0, None))
+        self.client.post('/reservations', json=self._make_reservation("other", 2, 10, 30))
+
+        # Listings are columnar; JSON stays the default, including for */*.
+        columns = unpackb(self.client.get('/reservations', headers=packed).data)
+        self.assertEqual(columns['id'][0], created['id'])
+        self.assertEqual(columns['username'], ["packer", "other"])
+        listed = json.loads(self.client.get('/reservations', headers={'Accept': '*/*'}).data)
+        self.assertEqual([r['username'] for r in listed], ["packer", "other"])
+        self.assertEqual(unpackb(self.client.get('/reservations?view=day', headers=packed).data)['id'], [])
+        # Errors are JSON whatever the client accepts.
+        response = self.client.post('/reservations', json=payload, headers=packed)
+        self.assertEqual((response.status_code, response.mimetype), (409, 'application/json'))
+
+    def test_48_compressed_responses_cached_per_data_version(self):
+        self.app.config['COMPRESS_MIN_BYTES'] = 0
+        gz = {'Accept-Encoding': 'gzip'}
+        first = self._make_reservation("zip", 1, 10, 60)
+        self.client.post('/reservations', json=first)
+        self.client.post('/reservations', json=self._make_reservation("zip", 2, 10, 60))
+        plain = self.client.get('/reservations', headers={'Accept-Encoding': 'identity'})
+        self.assertNotIn('Content-Encoding', plain.headers)
+        self.assertEqual(set(plain.vary), {'Accept', 'Accept-Encoding'})
+
+        with mock.patch('compression.compress', wraps=compression.compress) as compress:
+            for _ in range(3):
+                response = self.client.get('/reservations', headers=gz)
+                self.assertEqual(response.headers['Content-Encoding'], 'gzip')
+                self.assertEqual(gzip.decompress(response.data), plain.data)
+            self.assertEqual(compress.call_count, 1)
+            # A booking moves the data version, so the listing is rebuilt and compressed again.
+            self.client.post('/reservations', json=self._make_reservation("zip", 3, 10, 60))
+            listed = json.loads(gzip.decompress(self.client.get('/reservations', headers=gz).data))
+            self.assertEqual(len(listed), 3)
+            self.assertEqual(compress.call_count, 2)
+
+        # A cached listing lapses when its first reservation ends.
+        start = PST.localize(datetime.strptime(first['start_time'], '%Y-%m-%d %H:%M:%S'))
+        with mock.patch('app.now_pst', return_value=start + timedelta(hours=2)):
+            self.assertEqual(len(json.loads(self.client.get('/reservations').data)), 2)
+
+        # Confirming a hold changes the listing too.
+        hold = json.loads(self.client.post('/reservations/hold', json=self._make_reservation("holder", 4, 10, 60)).data)
+        self.assertIn('hold_expires_at', json.loads(self.client.get('/reservations').data)[-1])
+        self.client.post(f"/reservations/{hold['id']}/confirm", json={"username": "holder"})
+        self.assertNotIn('hold_expires_at', json.loads(self.client.get('/reservations').data)[-1])
+
+        page = self.client.get('/', headers=gz)
+        self.assertEqual(page.headers['Content-Encoding'], 'gzip')
+        self.assertIn(b'<html', gzip.decompress(page.data))
+        # Uncached responses are compressed per request.
+        response = self.client.get('/resources', headers=gz)
+        self.assertEqual(json.loads(gzip.decompress(response.data))[0]['name'], 'default')
+        self.assertNotIn('Content-Encoding', self.client.get('/resources', headers={'Accept-Encoding': 'gzip;q=0'}).headers)
+
+    def test_49_fingerprinted_assets(self):
+        page = self.client.get('/').data.decode()
+        self.assertNotIn('moment-timezone-with-data', page)
+        for unused in ('moment-2.29.1', 'popper-2.5.4', 'bootstrap-4.5.2.min.js'):
+            self.assertNotIn(unused, page)
+        url = re.search(r'src="(/assets/vendor/jquery-3\.6\.4\.min\.[0-9a-f]{12}\.js)"', page).group(1)
+        response = self.client.get(url)
+        self.assertEqual(response.status_code, 200)
+        self.assertEqual(response.mimetype, 'text/javascript')
+        self.assertTrue(response.cache_control.immutable)
+        self.assertEqual(response.cache_control.max_age, 365 * 24 * 3600)
+        with open(os.path.join(REPO_ROOT, 'static', 'vendor', 'jquery-3.6.4.min.js'), 'rb') as f:
+            self.assertEqual(response.data, f.read())
+        gz = self.client.get(url, headers={'Accept-Encoding': 'gzip'})
+        self.assertEqual(gzip.decompress(gz.data), response.data)
+        self.assertEqual(self.client.get(url.replace('.min.', '.min.0')).status_code, 404)
+        self.assertEqual(self.client.get('/assets/vendor/jquery-3.6.4.min.js').status_code, 404)
+
+    def _expire(self, hold_id):
+        with self.app.app_context():
+            db.session.get(Reservation, hold_id).hold_expires_at = datetime.now(timezone.utc).replace(tzinfo=None) - timedelta(seconds=1)
+            db.session.commit()
+
+    def test_50_summary_removal_counts_unswept_holds(self):
+        # Two expired holds on one day: the sweeper releases both.
+        holds = [json.loads(self.client.post('/reservations/hold', json=self._make_reservation(name, 1, hour, 60)).data)['id']
+                 for name, hour in [("alice", 10), ("bob", 12)]]
+        for hold_id in holds:
+            self._expire(hold_id)
+        with self.app.app_context():
+            self.assertEqual(expire_holds(holds), 2)
+            self.assertEqual(DailySummary.query.count(), 0)
+
+        # A cancelled booking's day still counts an expired hold the sweeper hasn't reached.
+        booking = json.loads(self.client.post('/reservations', json=self._make_reservation("alice", 1, 10, 60)).data)
+        hold = json.loads(self.client.post('/reservations/hold', json=self._make_reservation("bob", 1, 12, 60)).data)
+        self._expire(hold['id'])
+        self.assertEqual(self.client.delete(f"/reservations/{booking['id']}", json={"username": "alice"}).status_code, 200)
+        with self.app.app_context():
+            row = DailySummary.query.one()
+            self.assertEqual((row.reservation_count, row.booked_minutes), (1, 60))
+            self.assertEqual(row.first_start.hour, 12)
+            self.assertEqual(expire_holds([hold['id']]), 1)
+            self.assertEqual(DailySummary.query.count(), 0)
+
+    def test_51_summary_after_cancel_ignores_blackouts(self):
+        day = (datetime.now(PST) + timedelta(days=2)).replace(tzinfo=None, hour=0, minute=0, second=0, microsecond=0)
+        early = json.loads(self.client.post('/reservations', json=self._make_reservation("alice", 2, 10, 60)).data)
+        self.assertEqual(self.client.post('/reservations', json=self._make_reservation("bob", 2, 12, 60)).status_code, 201)
+        self.assertEqual(self.client.post('/blackouts', json={
+            "start_time": day.replace(hour=8).strftime('%Y-%m-%d %H:%M'),
+            "end_time": day.replace(hour=9).strftime('%Y-%m-%d %H:%M')}).status_code, 201)
+        self.assertEqual(self.client.delete(f"/reservations/{early['id']}", json={"username": "alice"}).status_code, 200)
+
+        def summary():
+            return [(r.resource_id, r.day, r.booked_minutes, r.reservation_count, r.first_start, r.last_end)
+                    for r in DailySummary.query.order_by(DailySummary.resource_id, DailySummary.day)]
+        with self.app.app_context():
+            incremental = summary()
+            self.assertEqual(incremental[0][4], day.replace(hour=12))
+            rebuild_daily_summary()
+            self.assertEqual(summary(), incremental)
+
+    def test_52_resource_listing_cached_per_resource_version(self):
+        gpu1, gpu2 = self._create_resource("gpu-1"), self._create_resource("gpu-2")
+        self.client.post('/reservations', json=dict(self._make_reservation("alice", 1, 10, 60), resource_id=gpu1))
+        listing = f'/reservations?resource_id={gpu1}'
+        self.assertEqual(len(json.loads(self.client.get(listing).data)), 1)
+        with mock.patch('app.reservation_list_response', wraps=reservation_list_response) as build:
+            # Bookings on another resource leave this listing cached; the all-resources listing is rebuilt.
+            self.client.post('/reservations', json=dict(self._make_reservation("bob", 1, 10, 60), resource_id=gpu2))
+            self.assertEqual(len(json.loads(self.client.get(listing).data)), 1)
+            self.assertEqual(build.call_count, 0)
+            self.assertEqual(len(json.loads(self.client.get('/reservations').data)), 2)
+            self.assertEqual(build.call_count, 1)
+            self.client.post('/reservations', json=dict(self._make_reservation("bob", 1, 12, 60), resource_id=gpu1))
+            self.assertEqual(len(json.loads(self.client.get(listing).data)), 2)
+            self.assertEqual(build.call_count, 2)
+
+    def test_31_summary_validation(self):
+        self.assertEqual(self.client.get('/summary?from=2025-02-30').status_code, 400)
+        self.assertEqual(self.client.get('/summary?from=2025-07-10&to=2025-07-01').status_code, 400)
+        self.assertEqual(self.client.get('/summary?from=2024-01-01&to=2025-07-01').status_code, 400)
+        self.assertEqual(json.loads(self.client.get('/summary?from=2025-07-01&to=2025-07-31').data), [])
+
+class PoolConsistencyTestCase(unittest.TestCase):
+    """Two app instances (standing in for two workers) share one database file."""
+
+    def setUp(self):
+        self.tmpdir = tempfile.mkdtemp()
+        config = {'TESTING': True,
+                  'SQLALCHEMY_DATABASE_URI': f"sqlite:///{os.path.join(self.tmpdir, 'shared.db')}",
+                  'SCHEDULE_INDEX_SYNC_SECONDS': 3600}
+        self.app_a = create_app(config)
+        self.app_b = create_app(config)
+        self.client_a = self.app_a.test_client()
+        self.client_b = self.app_b.test_client()
+
+    def tearDown(self):
+        for app in (self.app_a, self.app_b):
+            with app.app_context():
+                db.session.remove()
+                db.engine.dispose()
+        shutil.rmtree(self.tmpdir, ignore_errors=True)
+
+    def test_stale_index_never_double_books(self):
+        ids = [json.loads(self.client_a.post('/resources', json={"name": f"n{i}", "pool": "p"}).data)['id']
+               for i in range(2)]
+        start = (datetime.now(PST) + timedelta(days=1)).replace(hour=10, minute=0, second=0, microsecond=0)
+        payload = {"username": "u", "start_time": start.strftime('%Y-%m-%d %H:%M'),
+                   "end_time": (start + timedelta(hours=1)).strftime('%Y-%m-%d %H:%M')}
+
+        # Worker A loads its index; worker B then takes both members behind its back.
+        self.assertEqual(self.client_a.post('/reservations', json=dict(payload, pool="p", username="a1")).status_code, 201)
+        later = dict(payload, start_time=(start + timedelta(hours=2)).strftime('%Y-%m-%d %H:%M'),
+                     end_time=(start + timedelta(hours=3)).strftime('%Y-%m-%d %H:%M'))
+        for rid in ids:
+            self.assertEqual(self.client_b.post('/reservations', json=dict(later, resource_id=rid)).status_code, 201)
+
+        # A's index still thinks both are free at that time; the version check must catch it.
+        self.assertEqual(self.client_a.post('/reservations', json=dict(later, pool="p")).status_code, 409)
+        # And an index that is stale the other way (missing a free member) still finds it.
+        self.assertEqual(self.client_a.post('/reservations', json=dict(payload, pool="p")).status_code, 201)
+
+        with self.app_a.app_context():
+            rows = Reservation.query.all()
+            for a in rows:
+                for b in rows:
+                    if a.id < b.id and a.resource_id == b.resource_id:
+                        self.assertFalse(a.start_time < b.end_time and b.start_time < a.end_time)
+
+class BusyDatabaseTestCase(unittest.TestCase):
+    def test_lock_timeout_is_503_with_retry_after(self):
+        tmpdir = tempfile.mkdtemp()
+        self.addCleanup(shutil.rmtree, tmpdir, True)
+        path = os.path.join(tmpdir, 'busy.db')
+        app = create_app({'TESTING': True, 'SQLALCHEMY_DATABASE_URI': f'sqlite:///{path}',
+                          'SQLITE_BUSY_TIMEOUT_SECONDS': 0.1})
+        start = (datetime.now(PST) + timedelta(days=1)).replace(hour=10, minute=0, second=0, microsecond=0)
+        payload = {"username": "u", "start_time": start.strftime('%Y-%m-%d %H:%M'),
+                   "end_time": (start + timedelta(hours=1)).strftime('%Y-%m-%d %H:%M')}
+
+        # Another writer holds the lock for longer than the busy timeout.
+        other = sqlite3.connect(path, isolation_level=None)
+        other.execute('BEGIN IMMEDIATE')
+        try:
+            response = app.test_client().post('/reservations', json=payload)
+        finally:
+            other.execute('ROLLBACK')
+            other.close()
+        self.assertEqual(response.status_code, 503)
+        self.assertEqual(response.headers['Retry-After'], '1')
+        self.assertEqual(app.test_client().post('/reservations', json=payload).status_code, 201)
+        with app.app_context():
+            db.session.remove()
+            db.engine.dispose()
+
+class RulesFileTestCase(unittest.TestCase):
+    def test_per_pool_rules_apply_and_reload(self):
+        handle, path = tempfile.mkstemp(suffix='.json')
+        os.close(handle)
+        self.addCleanup(os.remove, path)
+        with open(path, 'w') as f:
+            json.dump({"pools": {"gpu": {"max_minutes": 60}}}, f)
+        app = create_app({'TESTING': True, 'SQLALCHEMY_DATABASE_URI': 'sqlite:///:memory:',
+                          'RULES_FILE': path, 'RULES_RELOAD_SECONDS': 0})
+        client = app.test_client()
+        gpu = json.loads(client.post('/resources', json={"name": "gpu-1", "pool": "gpu"}).data)['id']
+        start = (datetime.now(PST) + timedelta(days=1)).replace(hour=10, minute=0, second=0, microsecond=0)
+        payload = {"username": "alice", "start_time": start.strftime('%Y-%m-%d %H:%M'),
+                   "end_time": (start + timedelta(minutes=90)).strftime('%Y-%m-%d %H:%M')}
+
+        response = client.post('/reservations', json=dict(payload, resource_id=gpu))
+        self.assertEqual(response.status_code, 400)
+        self.assertIn("1.0 hours", json.loads(response.data)['error'])
+        self.assertEqual(client.post('/reservations', json=dict(payload, pool="gpu")).status_code, 400)
+        self.assertEqual(client.get(f'/availability/next?duration=90m&resource_id={gpu}').status_code, 400)
+        self.assertEqual(client.post('/reservations', json=payload).status_code, 201)
+
+        with open(path, 'w') as f:
+            json.dump({"pools": {"gpu": {"max_minutes": 120}}}, f)
+        os.utime(path, ns=(time.time_ns() + 10**9,) * 2)
+        self.assertEqual(client.post('/reservations', json=dict(payload, resource_id=gpu)).status_code, 201)
+        with app.app_context():
+            db.session.remove()
+            db.drop_all()
+
+    def test_member_rules_apply_to_pool_bookings(self):
+        handle, path = tempfile.mkstemp(suffix='.json')
+        os.close(handle)
+        self.addCleanup(os.remove, path)
+        with open(path, 'w') as f:
+            json.dump({"resources": {"gpu-1": {"max_minutes": 60}}}, f)
+        app = create_app({'TESTING': True, 'SQLALCHEMY_DATABASE_URI': 'sqlite:///:memory:', 'RULES_FILE': path})
+        client = app.test_client()
+        client.post('/resources', json={"name": "gpu-1", "pool": "gpu"})
+        start = (datetime.now(PST) + timedelta(days=1)).replace(hour=10, minute=0, second=0, microsecond=0)
+        payload = {"username": "alice", "pool": "gpu", "start_time": start.strftime('%Y-%m-%d %H:%M'),
+                   "end_time": (start + timedelta(hours=3)).strftime('%Y-%m-%d %H:%M')}
+
+        # The pool allows 3 hours, but its only member does not.
+        response = client.post('/reservations', json=payload)
+        self.assertEqual(response.status_code, 400)
+        self.assertIn("1.0 hours", json.loads(response.data)['error'])
+        # A member without the override takes it, though gpu-1 would be picked first.
+        gpu2 = json.loads(client.post('/resources', json={"name": "gpu-2", "pool": "gpu"}).data)['id']
+        response = client.post('/reservations', json=payload)
+        self.assertEqual(response.status_code, 201)
+        self.assertEqual(json.loads(response.data)['resource_id'], gpu2)
+        # With gpu-2 taken, gpu-1's rules still refuse the booking.
+        self.assertEqual(client.post('/reservations', json=dict(payload, username="bob")).status_code, 400)
+        with app.app_context():
+            db.session.remove()
+            db.drop_all()
+
+class AnalyticsReplicaTestCase(unittest.TestCase):
+    def test_reads_go_to_the_analytics_database(self):
+        tmpdir = tempfile.mkdtemp()
+        try:
+            replica = os.path.join(tmpdir, 'replica.db')
+            make_replica = create_app({'TESTING': True, 'SQLALCHEMY_DATABASE_URI': f'sqlite:///{replica}'})
+            app = create_app({'TESTING': True, 'SQLALCHEMY_DATABASE_URI': 'sqlite:///:memory:',
+                              'ANALYTICS_DATABASE_URI': f'sqlite:///{replica}'})
+            client = app.test_client()
+            start = (datetime.now(PST) + timedelta(days=1)).replace(hour=9, minute=0, second=0, microsecond=0)
+            client.post('/reservations', json={"username": "primary-only", "start_time": start.strftime('%Y-%m-%d %H:%M'),
+                                               "end_time": (start + timedelta(hours=1)).strftime('%Y-%m-%d %H:%M')})
+            data = json.loads(client.get(f"/analytics?to={start.strftime('%Y-%m-%d')}").data)
+            # The replica has not caught up with the booking made on the primary.
+            self.assertEqual(data['top_users'], [])
+            for each in (make_replica, app):
+                with each.app_context():
+                    db.session.remove()
+                    db.engine.dispose()
+            app.extensions['analytics_engine'].dispose()
+        finally:
+            shutil.rmtree(tmpdir, ignore_errors=True)
+
+class LegacyDatabaseTestCase(unittest.TestCase):
+    """create_app() upgrades a database file written by the original app."""
+
+    def setUp(self):
+        self.tmpdir = tempfile.mkdtemp()
+        self.addCleanup(shutil.rmtree, self.tmpdir, True)
+        self.path = os.path.join(self.tmpdir, 'reservations.db')
+        self.start = (datetime.now(PST) + timedelta(days=1)).replace(
+            hour=9, minute=0, second=0, microsecond=0, tzinfo=None)
+        legacy = sqlite3.connect(self.path)
+        legacy.execute('CREATE TABLE reservation (id INTEGER NOT NULL, username VARCHAR(80) NOT NULL, '
+                       'start_time DATETIME NOT NULL, end_time DATETIME NOT NULL, PRIMARY KEY (id))')
+        legacy.execute('INSERT INTO reservation (username, start_time, end_time) VALUES (?, ?, ?)',
+                       ('old-timer', self.start.strftime('%Y-%m-%d %H:%M:%S.%f'),
+                        (self.start + timedelta(hours=1)).strftime('%Y-%m-%d %H:%M:%S.%f')))
+        legacy.commit()
+        legacy.close()
+
+    def make_app(self):
+        app = create_app({'TESTING': True, 'SQLALCHEMY_DATABASE_URI': f'sqlite:///{self.path}'})
+        def dispose():
+            with app.app_context():
+                db.session.remove()
+                db.engine.dispose()
+        self.addCleanup(dispose)
+        return app
+
+    def test_reservations_get_the_default_resource(self):
+        app = self.make_app()
+        with app.app_context():
+            resource_id, = db.session.execute(db.text('SELECT resource_id FROM reservation')).one()
+            self.assertEqual(resource_id, default_resource_id())
+            indexes = {index['name'] for index in db.inspect(db.engine).get_indexes('reservation')}
+            self.assertIn('ix_reservation_resource_start', indexes)
+        # A second start finds nothing left to do.
+        self.make_app()
+
+    def test_usernames_move_to_the_user_table(self):
+        app = self.make_app()
+        client = app.test_client()
+        self.assertEqual([r['username'] for r in json.loads(client.get('/users/old-timer/reservations').data)],
+                         ['old-timer'])
+        day = self.start.strftime('%Y-%m-%d')
+        self.assertEqual(json.loads(client.get(f'/summary?from={day}').data)[0]['booked_minutes'], 60)
+        payload = {"username": "old-timer", "start_time": (self.start + timedelta(hours=2)).strftime('%Y-%m-%d %H:%M'),
+                   "end_time": (self.start + timedelta(hours=3)).strftime('%Y-%m-%d %H:%M')}
+        self.assertEqual(client.post('/reservations', json=payload).status_code, 201)
+        with app.app_context():
+            self.assertNotIn('username', {c['name'] for c in db.inspect(db.engine).get_columns('reservation')})
+            self.assertEqual(User.query.count(), 1)
+            self.assertEqual(UsageLedger.query.one().booked_minutes, 120)
+
+class AppFactoryTestCase(unittest.TestCase):
+    def test_import_time_budget(self):
+        """Importing the module stays cheap and does not build the default app."""
+        script = (
+            "import time\n"
+            "t0 = time.perf_counter()\n"
+            "import app\n"
+            "elapsed = time.perf_counter() - t0\n"
+            "print(elapsed, '_default_app' in vars(app) and app._default_app is not None)\n"
+        )
+        out = subprocess.run([sys.executable, '-c', script], cwd=REPO_ROOT,
+                             capture_output=True, text=True, check=True).stdout.split()
+        self.assertLess(float(out[0]), IMPORT_TIME_BUDGET_SECONDS)
+        self.assertEqual(out[1], 'False')
+
+    def test_apps_are_isolated(self):
+        """Each factory call gets its own database binding."""
+        app_a, app_b = make_test_app(), make_test_app()
+        start = (datetime.now(PST) + timedelta(days=1)).replace(hour=9, minute=0, second=0, microsecond=0)
+        payload = {
+            "username": "isolated",
+            "start_time": start.strftime('%Y-%m-%d %H:%M'),
+            "end_time": (start + timedelta(hours=1)).strftime('%Y-%m-%d %H:%M'),
+        }
+        self.assertEqual(app_a.test_client().post('/reservations', json=payload).status_code, 201)
+        self.assertEqual(app_b.test_client().post('/reservations', json=payload).status_code, 201)
+        with app_b.app_context():
+            self.assertEqual(Reservation.query.count(), 1)
+
+    def test_module_level_app_is_lazy_singleton(self):
+        import app as app_module
+        with mock.patch.dict(os.environ, {'RESERVATION_DATABASE_URI': 'sqlite:///:memory:'}), \
+             mock.patch.object(app_module, '_default_app', None):
+            self.assertIs(app_module.app, app_module.app)
+
 if __name__ == '__main__':
     unittest.main()
@@ -0,0 +1,36 @@
+import os
+import shutil
+import tempfile
+import unittest
+from assets import VENDOR, AssetManifest, fingerprint
+
+class AssetManifestTestCase(unittest.TestCase):
+    def setUp(self):
+        self.root = tempfile.mkdtemp()
+        self.addCleanup(shutil.rmtree, self.root)
+        os.makedirs(os.path.join(self.root, 'vendor'))
+        with open(os.path.join(self.root, 'vendor', 'app.min.css'), 'wb') as f:
+            f.write(b'body{color:red}')
+
+    def test_urls_follow_content(self):
+        url = AssetManifest(self.root).url('vendor/app.min.css')
+        self.assertRegex(url, r'^/assets/vendor/app\.min\.[0-9a-f]{12}\.css$')
+        with open(os.path.join(self.root, 'vendor', 'app.min.css'), 'wb') as f:
+            f.write(b'body{color:blue}')
+        manifest = AssetManifest(self.root)
+        self.assertNotEqual(manifest.url('vendor/app.min.css'), url)
+        self.assertIsNone(manifest.body(url[len('/assets/'):]))
+        hashed = manifest.url('vendor/app.min.css')[len('/assets/'):]
+        self.assertEqual((manifest.body(hashed).body, manifest.body(hashed).mimetype), (b'body{color:blue}', 'text/css'))
+
+    def test_unvendored_library_falls_back_to_pinned_upstream(self):
+        manifest = AssetManifest(self.root)
+        self.assertEqual(manifest.url('vendor/flatpickr-4.6.13.min.js'), VENDOR['vendor/flatpickr-4.6.13.min.js'])
+        with self.assertRaises(KeyError):
+            manifest.url('vendor/missing.js')
+
+    def test_fingerprint(self):
+        self.assertEqual(fingerprint('a/b.min.js', b''), 'a/b.min.e3b0c44298fc.js')
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,41 @@
+import gzip
+import unittest
+from werkzeug.http import parse_accept_header
+from compression import BodyCache, CachedBody, brotli, choose_encoding, compress
+
+class CompressionTestCase(unittest.TestCase):
+    def test_choose_encoding(self):
+        self.assertEqual(choose_encoding(parse_accept_header('gzip, deflate')), 'gzip')
+        self.assertIsNone(choose_encoding(parse_accept_header('identity')))
+        self.assertIsNone(choose_encoding(parse_accept_header('gzip;q=0')))
+        self.assertIsNone(choose_encoding(parse_accept_header('')))
+        self.assertEqual(choose_encoding(parse_accept_header('gzip, br')), 'br' if brotli else 'gzip')
+
+    def test_variant_is_made_once_and_deterministic(self):
+        entry = CachedBody(b'{"a": 1}' * 100, 'application/json')
+        data = entry.variant('gzip')
+        self.assertIs(entry.variant('gzip'), data)
+        self.assertEqual(gzip.decompress(data), entry.body)
+        self.assertEqual(CachedBody(entry.body, 'application/json').variant('gzip'), data)
+        self.assertEqual(data, compress(entry.body, 'gzip'))
+
+    @unittest.skipUnless(brotli, 'brotli is not installed')
+    def test_brotli_variant(self):
+        entry = CachedBody(b'x' * 1000, 'text/html')
+        self.assertEqual(brotli.decompress(entry.variant('br')), entry.body)
+
+    def test_cache_evicts_least_recent_and_expired(self):
+        cache = BodyCache(max_entries=2)
+        cache.put('a', CachedBody(b'a', 'text/plain'))
+        cache.put('b', CachedBody(b'b', 'text/plain', valid_until=10))
+        cache.get('a')
+        cache.put('c', CachedBody(b'c', 'text/plain'))
+        self.assertIsNone(cache.get('b'))
+        self.assertEqual(cache.get('a').body, b'a')
+        cache.put('d', CachedBody(b'd', 'text/plain', valid_until=10))
+        self.assertEqual(cache.get('d', now=9).body, b'd')
+        self.assertIsNone(cache.get('d', now=10))
+        self.assertEqual(len(cache), 1)
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,66 @@
+import json
+import os
+import tempfile
+import unittest
+from datetime import datetime, timedelta
+from rules import RuleBook, RuleError, parse_rules
+
+CEILINGS = {'min_minutes': 15, 'max_minutes': 240, 'advance_days': 30}
+NOW = datetime(2030, 6, 3, 12, 0)
+
+def cutoff(now, limit):
+    return now.replace(hour=0, minute=0) + limit + timedelta(days=1)
+
+class RuleBookTestCase(unittest.TestCase):
+    def setUp(self):
+        handle, self.path = tempfile.mkstemp(suffix='.json')
+        os.close(handle)
+        self.addCleanup(os.remove, self.path)
+
+    def _write(self, document, mtime):
+        with open(self.path, 'w') as f:
+            json.dump(document, f)
+        os.utime(self.path, ns=(mtime, mtime))
+
+    def test_resource_overrides_pool_overrides_default(self):
+        self._write({"default": {"advance_days": 14}, "pools": {"gpu": {"max_minutes": 60, "min_minutes": 30}},
+                     "resources": {"gpu-1": {"min_minutes": 45}}}, 1)
+        book = RuleBook(CEILINGS, cutoff, path=self.path, reload_seconds=0)
+        rules = book.for_resource(1, lambda: ('gpu-1', 'gpu'))
+        self.assertEqual((rules.min_duration, rules.max_duration, rules.advance_limit),
+                         (timedelta(minutes=45), timedelta(minutes=60), timedelta(days=14)))
+        self.assertEqual(book.for_pool('gpu').min_duration, timedelta(minutes=30))
+        self.assertEqual(book.for_resource(2, lambda: ('cpu-1', None)).max_duration, timedelta(minutes=240))
+        # Compiled rule sets are cached per resource.
+        self.assertIs(book.for_resource(1, lambda: self.fail('not cached')), rules)
+
+    def test_checks_report_the_first_broken_rule(self):
+        rules = RuleBook(CEILINGS, cutoff).for_pool(None)
+        at = NOW + timedelta(days=1)
+        self.assertIsNone(rules.check(at, at + timedelta(hours=1), NOW))
+        self.assertEqual(rules.check(at, at, NOW), "End time must be after start time")
+        self.assertIn("Minimum", rules.check(at, at + timedelta(minutes=5), NOW))
+        self.assertIn("Maximum", rules.check(at, at + timedelta(hours=5), NOW))
+        self.assertIn("30 days", rules.check(at + timedelta(days=31), at + timedelta(days=31, hours=1), NOW))
+
+    def test_hot_reload_keeps_last_good_rules(self):
+        self._write({"default": {"max_minutes": 60}}, 1)
+        book = RuleBook(CEILINGS, cutoff, path=self.path, reload_seconds=0)
+        self.assertEqual(book.for_pool('gpu').max_duration, timedelta(minutes=60))
+        self._write({"default": {"max_minutes": 120}}, 2)
+        self.assertEqual(book.for_pool('gpu').max_duration, timedelta(minutes=120))
+        with open(self.path, 'w') as f:
+            f.write('{not json')
+        os.utime(self.path, ns=(3, 3))
+        with self.assertLogs('rules', level='ERROR'):
+            self.assertEqual(book.for_pool('gpu').max_duration, timedelta(minutes=120))
+
+    def test_limits_cannot_exceed_built_in_values(self):
+        for document in [{"default": {"max_minutes": 300}}, {"pools": {"gpu": {"advance_days": 31}}},
+                         {"resources": {"a": {"min_minutes": 241}}}, {"default": {"max": 1}},
+                         {"default": {"max_minutes": "60"}}, {"other": {}}, []]:
+            with self.assertRaises(RuleError, msg=json.dumps(document)):
+                parse_rules(json.dumps(document), CEILINGS)
+
+if __name__ == '__main__':
+    unittest.main()
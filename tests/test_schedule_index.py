@@ -0,0 +1,129 @@
+import unittest
+from datetime import datetime, timedelta
+from schedule_index import ScheduleIndex, Timeline
+
+DAY = datetime(2030, 6, 3)
+
+def at(hour, minute=0):
+    return DAY + timedelta(hours=hour, minutes=minute)
+
+class TimelineTestCase(unittest.TestCase):
+    def test_is_free_and_free_gap(self):
+        timeline = Timeline([(at(12), at(13)), (at(9), at(10))])
+        self.assertEqual(timeline.starts, [at(9), at(12)])
+        self.assertTrue(timeline.is_free(at(10), at(12)))
+        self.assertTrue(timeline.is_free(at(8), at(9)))
+        self.assertFalse(timeline.is_free(at(9, 30), at(10, 30)))
+        self.assertFalse(timeline.is_free(at(8), at(14)))
+        self.assertEqual(timeline.free_gap(at(10, 30), at(11)), (at(10), at(12)))
+        self.assertEqual(timeline.free_gap(at(7), at(8)), (None, at(9)))
+        self.assertEqual(timeline.free_gap(at(14), at(15)), (at(13), None))
+
+    def test_add_and_remove(self):
+        timeline = Timeline()
+        timeline.add(at(12), at(13))
+        timeline.add(at(9), at(10))
+        self.assertEqual(timeline.intervals(), [(at(9), at(10)), (at(12), at(13))])
+        self.assertTrue(timeline.remove(at(9), at(10)))
+        self.assertFalse(timeline.remove(at(9), at(10)))
+        self.assertEqual(len(timeline), 1)
+
+class ScheduleIndexTestCase(unittest.TestCase):
+    def setUp(self):
+        self.index = ScheduleIndex(slack_cap_slots=16)
+
+    def _pool(self, timelines, pool='gpu'):
+        stale = self.index.set_pool(pool, {rid: 0 for rid in timelines})
+        self.assertEqual(sorted(stale), sorted(timelines))
+        for rid, intervals in timelines.items():
+            self.index.load(rid, 0, intervals)
+
+    def test_free_members_aligned(self):
+        self._pool({1: [(at(9), at(10))], 2: [(at(10), at(11))], 3: []})
+        self.assertEqual(self.index.free_members('gpu', at(9), at(10)), (1 << 2) | (1 << 3))
+        self.assertEqual(self.index.free_members('gpu', at(9, 30), at(10, 30)), 1 << 3)
+        self.assertEqual(self.index.free_members('other', at(9), at(10)), 0)
+
+    def test_free_members_unaligned_edges_are_exact(self):
+        # Resource 1 is busy until 10:05; a request from 10:05 shares its slot but is free.
+        self._pool({1: [(at(9), at(10, 5))], 2: [(at(10, 10), at(11))]})
+        self.assertEqual(self.index.free_members('gpu', at(10, 5), at(10, 10)), (1 << 1) | (1 << 2))
+        self.assertEqual(self.index.free_members('gpu', at(10, 0), at(10, 10)), 1 << 2)
+        self.assertEqual(self.index.free_members('gpu', at(10, 5), at(10, 20)), 1 << 1)
+
+    def test_best_fit_prefers_tightest_gap(self):
+        self._pool({
+            1: [],                                   # wide open
+            2: [(at(8), at(10)), (at(12), at(14))],  # 2h gap around the request
+            3: [(at(9), at(10)), (at(11), at(12))],  # exactly the request's hour free
+        })
+        self.assertEqual(self.index.best_fit('gpu', at(10), at(11)), 3)
+        self.assertEqual(self.index.best_fit('gpu', at(10), at(12)), 2)
+        # After 14:00, resource 2's gap starts closest to the request.
+        self.assertEqual(self.index.best_fit('gpu', at(15), at(16)), 2)
+        self.assertEqual(self.index.best_fit('gpu', at(9), at(9, 30)), 1)
+        # Excluded members are skipped in favour of the next best fit.
+        self.assertEqual(self.index.best_fit('gpu', at(10), at(11), exclude=1 << 3), 2)
+        self.assertIsNone(self.index.best_fit('gpu', at(10), at(11), exclude=0b1110))
+
+    def test_best_fit_none_when_pool_full(self):
+        self._pool({1: [(at(9), at(12))], 2: [(at(10), at(11))]})
+        self.assertIsNone(self.index.best_fit('gpu', at(10), at(10, 30)))
+
+    def test_record_keeps_index_current_or_drops_stale(self):
+        self._pool({1: [], 2: []})
+        self.index.record(1, at(10), at(11), 1)
+        self.assertEqual(self.index.version(1), 1)
+        self.assertEqual(self.index.best_fit('gpu', at(10), at(11)), 2)
+
+        # A version jump means another writer changed the resource; the timeline is dropped.
+        self.index.record(2, at(12), at(13), 5)
+        self.assertIsNone(self.index.version(2))
+        self.assertIsNone(self.index.best_fit('gpu', at(10), at(11)))
+        self.assertEqual(self.index.set_pool('gpu', {1: 1, 2: 5}), [2])
+
+    def test_unrecord_frees_slots_not_shared(self):
+        # Resource 1: 9:00-10:05 and 10:05-11:00 share the 10:00 slot.
+        self._pool({1: [(at(9), at(10, 5)), (at(10, 5), at(11))]})
+        self.index.unrecord(1, at(9), at(10, 5), 1)
+        self.assertEqual(self.index.version(1), 1)
+        self.assertEqual(self.index.free_members('gpu', at(9), at(10)), 1 << 1)
+        self.assertEqual(self.index.free_members('gpu', at(10), at(10, 5)), 1 << 1)
+        self.assertEqual(self.index.free_members('gpu', at(10), at(10, 15)), 0)
+
+        # Removing an interval the index never had drops the timeline.
+        self.index.unrecord(1, at(12), at(13), 2)
+        self.assertIsNone(self.index.version(1))
+
+    def test_move_shrinks_and_shifts(self):
+        self._pool({1: [(at(9), at(11))], 2: [(at(9), at(10))]})
+        self.index.move(1, at(9), at(11), at(9), at(9, 30), 1)
+        self.assertEqual(self.index.timeline(1).intervals(), [(at(9), at(9, 30))])
+        self.assertEqual(self.index.free_members('gpu', at(10), at(11)), (1 << 1) | (1 << 2))
+        self.index.move(1, at(9), at(9, 30), at(12), at(13), 2)
+        self.assertEqual(self.index.free_members('gpu', at(9), at(9, 30)), 1 << 1)
+        self.assertEqual(self.index.free_members('gpu', at(12), at(13)), 1 << 2)
+        self.index.move(1, at(9), at(9, 30), at(14), at(15), 3)
+        self.assertIsNone(self.index.version(1))
+
+    def test_touch_only_advances_version(self):
+        self._pool({1: [(at(9), at(10))]})
+        self.index.touch(1, 1)
+        self.assertEqual((self.index.version(1), self.index.timeline(1).intervals()), (1, [(at(9), at(10))]))
+        self.index.touch(1, 3)
+        self.assertIsNone(self.index.version(1))
+
+    def test_load_replaces_busy_slots(self):
+        self._pool({1: [(at(10), at(11))]})
+        self.assertIsNone(self.index.best_fit('gpu', at(10), at(11)))
+        self.index.load(1, 1, [])
+        self.assertEqual(self.index.best_fit('gpu', at(10), at(11)), 1)
+
+    def test_prune_forgets_past_slots(self):
+        self._pool({1: [(at(1), at(2)), (at(10), at(11))]})
+        self.index.prune(at(5))
+        self.assertEqual(self.index.free_members('gpu', at(1), at(2)), 1 << 1)
+        self.assertEqual(self.index.free_members('gpu', at(10), at(11)), 0)
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,39 @@
+import json
+import unittest
+from schemas import BOOKING, HOLD, OWNER, SchemaError
+
+BODY = {"username": "alice", "start_time": "2030-06-03 10:00", "end_time": "2030-06-03 11:00"}
+
+class SchemaTestCase(unittest.TestCase):
+    def _decode(self, schema, document):
+        return schema.decode(json.dumps(document).encode())
+
+    def test_decodes_into_typed_tuple_with_defaults(self):
+        booking = self._decode(BOOKING, dict(BODY, resource_id=2))
+        self.assertIs(type(booking), BOOKING.type)
+        self.assertEqual((booking.username, booking.resource_id, booking.pool), ("alice", 2, None))
+        self.assertEqual((booking.priority, booking.waitlist), (0, False))
+        self.assertEqual(self._decode(HOLD, dict(BODY, ttl_seconds=30)).ttl_seconds, 30)
+        self.assertEqual(self._decode(BOOKING, dict(BODY, priority=None)).priority, 0)
+
+    def test_types_are_strict(self):
+        for field, value in [("resource_id", True), ("resource_id", "2"), ("priority", 1.0),
+                             ("waitlist", 1), ("waitlist", "true"), ("pool", 3), ("pool", {"name": "gpu"})]:
+            with self.assertRaises(SchemaError, msg=(field, value)):
+                self._decode(BOOKING, dict(BODY, **{field: value}))
+
+    def test_rejects_shape_errors(self):
+        with self.assertRaisesRegex(SchemaError, "Missing required fields"):
+            self._decode(BOOKING, dict(BODY, username=""))
+        with self.assertRaisesRegex(SchemaError, "Missing required fields"):
+            self._decode(OWNER, {})
+        with self.assertRaisesRegex(SchemaError, "Unknown field: ttl_seconds"):
+            self._decode(BOOKING, dict(BODY, ttl_seconds=30))
+        with self.assertRaisesRegex(SchemaError, "Duplicate field"):
+            OWNER.decode(b'{"username": "a", "username": "b"}')
+        for body in [b'', b'not json', b'"alice"', b'[{"username": "a"}]', b'\xff', b'[' * 100000]:
+            with self.assertRaises(SchemaError, msg=body[:10]):
+                OWNER.decode(body)
+
+if __name__ == '__main__':
+    unittest.main()
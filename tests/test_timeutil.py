@@ -0,0 +1,88 @@
+import unittest
+from datetime import datetime, timedelta
+import pytz
+import timeutil
+from timeutil import (PST, AmbiguousTimeError, NonExistentTimeError, format_local,
+                      localize, now_pst, parse_local, wall_offset, wall_to_epoch)
+
+def _transitions(first_year, last_year):
+    """Naive UTC transition instants pytz knows about in [first_year, last_year]."""
+    return [t for t in PST._utc_transition_times if first_year <= t.year <= last_year]
+
+class ParseLocalTestCase(unittest.TestCase):
+    def test_accepted_formats(self):
+        self.assertEqual(parse_local('2025-07-02 14:05'), datetime(2025, 7, 2, 14, 5))
+        self.assertEqual(parse_local('2025-07-02 14:05:09'), datetime(2025, 7, 2, 14, 5, 9))
+        self.assertEqual(parse_local('2025-07-02T14:05:09'), datetime(2025, 7, 2, 14, 5, 9))
+
+    def test_rejected_formats(self):
+        for value in ['', '2025-07-02', '2025-7-2 14:05', '2025/07/02 14:05', '2025-07-02 14:5',
+                      '2025-07-02 14:05:09.123', '2025-07-02T14:05:09-07:00', 'July 25, 2025 10:00 AM',
+                      '2025-07-02 1a:05', '2025-02-30 10:00', '2025-07-02 24:00', '２０２５-07-02 14:05',
+                      None, 20250702]:
+            with self.assertRaises(ValueError, msg=repr(value)):
+                parse_local(value)
+
+class OffsetTableTestCase(unittest.TestCase):
+    def test_every_minute_around_transitions_matches_pytz(self):
+        """Each minute within 3h of every transition through 2037 agrees with pytz(is_dst=None)."""
+        for utc in _transitions(1970, 2037):
+            wall_center = utc - timedelta(hours=8) # near the local wall time of the switch
+            for minute in range(-180, 181):
+                wall = wall_center + timedelta(minutes=minute)
+                try:
+                    expected = PST.localize(wall, is_dst=None).utcoffset()
+                except pytz.exceptions.NonExistentTimeError:
+                    with self.assertRaises(NonExistentTimeError, msg=str(wall)):
+                        localize(wall)
+                    continue
+                except pytz.exceptions.AmbiguousTimeError:
+                    with self.assertRaises(AmbiguousTimeError, msg=str(wall)):
+                        localize(wall)
+                    continue
+                self.assertEqual(localize(wall).utcoffset(), expected, str(wall))
+
+    def test_gap_and_overlap_bounds(self):
+        # 2025: spring forward 02:00 -> 03:00 on Mar 9, fall back 02:00 -> 01:00 on Nov 2.
+        self.assertEqual(localize(datetime(2025, 3, 9, 1, 59, 59)).utcoffset(), timedelta(hours=-8))
+        for wall in [datetime(2025, 3, 9, 2, 0), datetime(2025, 3, 9, 2, 30), datetime(2025, 3, 9, 2, 59, 59)]:
+            with self.assertRaises(NonExistentTimeError):
+                localize(wall)
+        self.assertEqual(localize(datetime(2025, 3, 9, 3, 0)).utcoffset(), timedelta(hours=-7))
+
+        self.assertEqual(localize(datetime(2025, 11, 2, 0, 59, 59)).utcoffset(), timedelta(hours=-7))
+        for wall in [datetime(2025, 11, 2, 1, 0), datetime(2025, 11, 2, 1, 30), datetime(2025, 11, 2, 1, 59, 59)]:
+            with self.assertRaises(AmbiguousTimeError):
+                localize(wall)
+        self.assertEqual(localize(datetime(2025, 11, 2, 2, 0)).utcoffset(), timedelta(hours=-8))
+
+    def test_non_strict_matches_localize_default(self):
+        """Stored values in a gap or overlap format the way PST.localize() interpreted them."""
+        for wall in [datetime(2025, 3, 9, 2, 30), datetime(2025, 11, 2, 1, 30)]:
+            self.assertEqual(wall_offset(wall, strict=False), PST.localize(wall).utcoffset())
+
+    def test_format_local_matches_isoformat(self):
+        start = datetime(2024, 1, 1)
+        for hours in range(0, 24 * 366, 7):
+            wall = start + timedelta(hours=hours, minutes=hours % 60)
+            try:
+                expected = PST.localize(wall, is_dst=None).isoformat()
+            except (pytz.exceptions.NonExistentTimeError, pytz.exceptions.AmbiguousTimeError):
+                continue
+            self.assertEqual(format_local(wall), expected)
+
+    def test_wall_to_epoch(self):
+        for wall in [datetime(2025, 7, 2, 14, 0), datetime(2025, 12, 2, 14, 0)]:
+            self.assertEqual(wall_to_epoch(wall), int(PST.localize(wall).timestamp()))
+
+    def test_now_pst(self):
+        ours = now_pst()
+        reference = datetime.now(PST)
+        self.assertEqual(ours.utcoffset(), reference.utcoffset())
+        self.assertLess(abs((reference - ours).total_seconds()), 5)
+
+    def test_table_covers_booking_horizon(self):
+        self.assertGreaterEqual(timeutil._UTC_TIMES[-1].year, datetime.now().year + 1)
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,48 @@
+import unittest
+from timing_wheel import TimingWheel
+
+class TimingWheelTestCase(unittest.TestCase):
+    def setUp(self):
+        self.wheel = TimingWheel(tick=1.0, slots=8, now=1000)
+
+    def test_expires_in_deadline_order_of_ticks(self):
+        self.wheel.schedule('a', 1002.5)
+        self.wheel.schedule('b', 1001)
+        self.wheel.schedule('c', 1005)
+        self.assertEqual(self.wheel.advance(1000.9), [])
+        self.assertEqual(self.wheel.advance(1001), ['b'])
+        self.assertEqual(self.wheel.advance(1002.9), [])
+        self.assertEqual(self.wheel.advance(1003), ['a'])
+        self.assertEqual(len(self.wheel), 1)
+        self.assertEqual(self.wheel.advance(1010), ['c'])
+        self.assertEqual(len(self.wheel), 0)
+
+    def test_entries_beyond_one_rotation_wait_their_turn(self):
+        self.wheel.schedule('far', 1000 + 8 * 3 + 1)  # same bucket as tick 1001, three rotations later
+        self.wheel.schedule('near', 1001)
+        self.assertEqual(self.wheel.advance(1001), ['near'])
+        self.assertEqual(self.wheel.advance(1024), [])
+        self.assertEqual(self.wheel.advance(1025), ['far'])
+
+    def test_long_stall_visits_every_bucket_once(self):
+        for i in range(8):
+            self.wheel.schedule(i, 1001 + i)
+        self.assertEqual(sorted(self.wheel.advance(5000)), list(range(8)))
+
+    def test_reschedule_and_cancel(self):
+        self.wheel.schedule('a', 1001)
+        self.wheel.schedule('a', 1004)
+        self.wheel.schedule('b', 1002)
+        self.wheel.cancel('b')
+        self.wheel.cancel('missing')
+        self.assertEqual(self.wheel.advance(1003), [])
+        self.assertEqual(self.wheel.advance(1004), ['a'])
+
+    def test_past_deadline_expires_on_next_advance(self):
+        self.wheel.advance(1010)
+        self.wheel.schedule('late', 900)
+        self.assertEqual(self.wheel.advance(1010.5), [])
+        self.assertEqual(self.wheel.advance(1011), ['late'])
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,139 @@
+"""Fixed-format timestamp parsing and cached America/Los_Angeles offsets.
+
+The API only accepts naive PST wall-clock strings in the form
+`YYYY-MM-DD HH:MM[:SS]` (a `T` separator is also accepted). Parsing them with
+dateutil and localizing with pytz on every request is far more general than
+needed. Here the zone's DST transitions are read from pytz once at import into
+sorted tables. Offsets are then found with a binary search.
+
+Local times that fall in a DST gap (spring forward) or overlap (fall back) are
+reported with NonExistentTimeError / AmbiguousTimeError instead of being
+silently shifted the way `PST.localize()` does by default.
+"""
+from bisect import bisect_right
+from datetime import datetime, timezone
+import pytz
+
+PST = pytz.timezone('America/Los_Angeles')
+
+class NonExistentTimeError(ValueError):
+    """Local time skipped by a spring-forward transition."""
+
+class AmbiguousTimeError(ValueError):
+    """Local time that occurs twice because of a fall-back transition."""
+
+def _offset_suffix(offset):
+    minutes = int(offset.total_seconds()) // 60
+    sign = '-' if minutes < 0 else '+'
+    hours, minutes = divmod(abs(minutes), 60)
+    return f'{sign}{hours:02d}:{minutes:02d}'
+
+def _build_tables(tz):
+    """Flattens pytz's transition data into parallel sorted lists.
+
+    For each transition i, the wall-clock interval [_wall_starts[i], _wall_ends[i])
+    is the gap (offset increases) or the overlap (offset decreases). From
+    _wall_ends[i] until the next transition, wall times map to _offsets[i].
+    """
+    utc_times = tz._utc_transition_times
+    infos = tz._transition_info
+    wall_starts, wall_ends, offsets, gap = [], [], [], []
+    prev = infos[0][0]
+    for utc_time, info in zip(utc_times[1:], infos[1:]):
+        offset = info[0]
+        wall_starts.append(utc_time + min(prev, offset))
+        wall_ends.append(utc_time + max(prev, offset))
+        offsets.append(offset)
+        gap.append(offset > prev)
+        prev = offset
+    return infos[0][0], list(utc_times[1:]), wall_starts, wall_ends, offsets, gap
+
+_INITIAL_OFFSET, _UTC_TIMES, _WALL_STARTS, _WALL_ENDS, _OFFSETS, _GAP = _build_tables(PST)
+
+# One shared fixed-offset tzinfo and ISO suffix per distinct offset.
+_TZINFOS = {o: timezone(o) for o in set(_OFFSETS) | {_INITIAL_OFFSET}}
+_SUFFIXES = {o: _offset_suffix(o) for o in _TZINFOS}
+
+_EPOCH = datetime(1970, 1, 1)
+
+def parse_local(value):
+    """Parses `YYYY-MM-DD HH:MM` or `YYYY-MM-DD HH:MM:SS` into a naive datetime.
+
+    Raises ValueError for anything else, including out-of-range fields.
+    """
+    if not isinstance(value, str):
+        raise ValueError('timestamp must be a string')
+    n = len(value)
+    if n not in (16, 19):
+        raise ValueError(f'invalid timestamp: {value!r}')
+    if (value[4] != '-' or value[7] != '-' or value[10] not in ' T' or value[13] != ':'
+            or (n == 19 and value[16] != ':')):
+        raise ValueError(f'invalid timestamp: {value!r}')
+    digits = value[0:4] + value[5:7] + value[8:10] + value[11:13] + value[14:16] + (value[17:19] if n == 19 else '00')
+    if not digits.isdigit() or not digits.isascii():
+        raise ValueError(f'invalid timestamp: {value!r}')
+    return datetime(int(digits[0:4]), int(digits[4:6]), int(digits[6:8]),
+                    int(digits[8:10]), int(digits[10:12]), int(digits[12:14]))
+
+def wall_offset(wall, strict=True):
+    """Returns the UTC offset for a naive PST wall-clock time.
+
+    With strict=True, times inside a DST gap or overlap raise. Otherwise the
+    standard-time offset is used. That matches the `PST.localize()` default
+    that values stored before strict validation went through.
+    """
+    i = bisect_right(_WALL_STARTS, wall) - 1
+    if i < 0:
+        return _INITIAL_OFFSET
+    if wall < _WALL_ENDS[i]:
+        if strict:
+            if _GAP[i]:
+                raise NonExistentTimeError(f'{wall} does not exist in America/Los_Angeles')
+            raise AmbiguousTimeError(f'{wall} is ambiguous in America/Los_Angeles')
+        return min(_OFFSETS[i], _OFFSETS[i - 1] if i > 0 else _INITIAL_OFFSET)
+    return _OFFSETS[i]
+
+def localize(wall):
+    """Attaches the PST offset to a naive wall-clock time (strict, see wall_offset)."""
+    return wall.replace(tzinfo=_TZINFOS[wall_offset(wall)])
+
+def utc_offset(utc):
+    """Returns the PST offset in effect at a naive UTC instant."""
+    i = bisect_right(_UTC_TIMES, utc) - 1
+    return _OFFSETS[i] if i >= 0 else _INITIAL_OFFSET
+
+def now_utc():
+    """Current time as a naive UTC datetime, for deadlines that must not follow DST."""
+    return datetime.now(timezone.utc).replace(tzinfo=None)
+
+def now_pst():
+    """Current time as an aware PST datetime, without going through pytz."""
+    utc = now_utc()
+    offset = utc_offset(utc)
+    return (utc + offset).replace(tzinfo=_TZINFOS[offset])
+
+def format_local(wall):
+    """Formats a naive PST wall-clock time as ISO 8601 with its offset.
+
+    Equivalent to `localize(wall).isoformat()` for whole-second values, but
+    does not raise on stored values that fall in a DST gap or overlap.
+    """
+    suffix = _SUFFIXES[wall_offset(wall, strict=False)]
+    return '%04d-%02d-%02dT%02d:%02d:%02d%s' % (
+        wall.year, wall.month, wall.day, wall.hour, wall.minute, wall.second, suffix)
+
+def add_elapsed(wall, delta):
+    """Naive wall-clock time `delta` of real time after `wall`.
+
+    Differs from `wall + delta` by an hour when a DST change falls in between.
+    """
+    utc = wall - wall_offset(wall, strict=False) + delta
+    return utc + utc_offset(utc)
+
+def wall_to_epoch(wall):
+    """Converts a naive PST wall-clock time to integer seconds since the Unix epoch."""
+    return int((wall - wall_offset(wall, strict=False) - _EPOCH).total_seconds())
+
+def utc_to_epoch(utc):
+    """Converts a naive UTC datetime to integer seconds since the Unix epoch."""
+    return int((utc - _EPOCH).total_seconds())
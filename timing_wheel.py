@@ -0,0 +1,60 @@
+"""Hashed timing wheel for expiring short-lived entries such as booking holds.
+
+Deadlines are rounded up to whole ticks and hashed into a fixed ring of
+buckets by tick number. Each entry keeps its absolute tick, so entries more
+than one rotation away simply stay in their bucket until their turn comes.
+advance() visits only the buckets of the ticks that have passed. Expiring an
+entry therefore costs O(1) amortized, however many entries are pending, and
+nothing has to scan the database to find them.
+"""
+import math
+import threading
+import time
+
+class TimingWheel:
+    def __init__(self, tick=1.0, slots=512, now=None):
+        self.tick = tick
+        self._buckets = [{} for _ in range(slots)]  # key -> deadline tick
+        self._where = {}                             # key -> bucket index
+        self._lock = threading.Lock()
+        # Last tick whose bucket has been processed.
+        self._current = math.floor((time.time() if now is None else now) / tick)
+
+    def __len__(self):
+        with self._lock:
+            return len(self._where)
+
+    def schedule(self, key, deadline):
+        """Expires `key` at `deadline` (seconds since the epoch), replacing any earlier schedule."""
+        with self._lock:
+            self._remove(key)
+            # Already-due entries go into the next tick so the next advance() sees them.
+            due = max(math.ceil(deadline / self.tick), self._current + 1)
+            bucket = due % len(self._buckets)
+            self._buckets[bucket][key] = due
+            self._where[key] = bucket
+
+    def cancel(self, key):
+        with self._lock:
+            self._remove(key)
+
+    def advance(self, now=None):
+        """Removes and returns the keys whose deadline is at or before `now`."""
+        with self._lock:
+            target = math.floor((time.time() if now is None else now) / self.tick)
+            expired = []
+            # After a stall longer than one rotation every bucket is visited once.
+            for due in range(self._current + 1, min(target, self._current + len(self._buckets)) + 1):
+                bucket = self._buckets[due % len(self._buckets)]
+                ready = [key for key, tick in bucket.items() if tick <= target]
+                for key in ready:
+                    del bucket[key]
+                    del self._where[key]
+                expired.extend(ready)
+            self._current = max(self._current, target)
+            return expired
+
+    def _remove(self, key):
+        bucket = self._where.pop(key, None)
+        if bucket is not None:
+            del self._buckets[bucket][key]
@@ -0,0 +1,70 @@
+"""Benchmark for pooled best-fit allocation in the in-memory schedule index.
+
+Fills pools of different sizes with random bookings over a month and times
+ScheduleIndex.best_fit for random requests. Allocation cost should stay flat as
+the pool grows.
+
+Usage:
+    python tools/bench_pool_alloc.py [--sizes 5,50,500] [--bookings-per-resource 60]
+"""
+import argparse
+import os
+import random
+import sys
+import timeit
+from datetime import datetime
+
+sys.path.insert(0, os.path.dirname(os.path.dirname(os.path.abspath(__file__))))
+
+from schedule_index import SLOT, ScheduleIndex  # noqa: E402
+
+HORIZON_SLOTS = 30 * 96
+SLACK_CAP_SLOTS = 16
+
+def random_timeline(rng, start, bookings):
+    busy = set()
+    intervals = []
+    for _ in range(bookings):
+        first = rng.randrange(HORIZON_SLOTS - 16)
+        length = rng.randint(1, 16)
+        slots = range(first, first + length)
+        if busy.intersection(slots):
+            continue
+        busy.update(slots)
+        intervals.append((start + first * SLOT, start + (first + length) * SLOT))
+    return intervals
+
+def build_index(size, bookings, seed):
+    rng = random.Random(seed)
+    start = datetime(2030, 1, 1)
+    index = ScheduleIndex(slack_cap_slots=SLACK_CAP_SLOTS)
+    versions = {rid: 0 for rid in range(1, size + 1)}
+    index.set_pool('bench', versions)
+    for rid in versions:
+        index.load(rid, 0, random_timeline(rng, start, bookings))
+    requests = []
+    for _ in range(1000):
+        first = rng.randrange(HORIZON_SLOTS - 16)
+        requests.append((start + first * SLOT, start + (first + rng.randint(1, 16)) * SLOT))
+    return index, requests
+
+def main(argv=None):
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument('--sizes', default='5,50,500')
+    ap.add_argument('--bookings-per-resource', type=int, default=60)
+    ap.add_argument('--seed', type=int, default=1)
+    opts = ap.parse_args(argv)
+
+    for size in [int(s) for s in opts.sizes.split(',')]:
+        index, requests = build_index(size, opts.bookings_per_resource, opts.seed)
+        it = iter(requests * 1000)
+
+        def one():
+            start, end = next(it)
+            index.best_fit('bench', start, end)
+
+        best = min(timeit.repeat(one, number=len(requests), repeat=5)) / len(requests)
+        print(f'pool size {size:>5}: {best * 1e6:8.2f} us per best_fit')
+
+if __name__ == '__main__':
+    main()
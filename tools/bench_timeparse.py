@@ -0,0 +1,64 @@
+"""Benchmark for the timestamp parsing / localizing / formatting hot path.
+
+Compares what create_reservation and Reservation.to_dict used to do (dateutil
+isoparse + pytz localize + isoformat) against timeutil's fixed-format parser
+and offset table.
+
+Usage:
+    python tools/bench_timeparse.py [--number 20000]
+"""
+import argparse
+import os
+import sys
+import timeit
+
+sys.path.insert(0, os.path.dirname(os.path.dirname(os.path.abspath(__file__))))
+
+from dateutil import parser  # noqa: E402
+import timeutil  # noqa: E402
+from timeutil import PST  # noqa: E402
+
+SAMPLES = ['2025-07-02 14:00', '2025-12-02 09:15:00', '2026-03-08 03:30', '2026-11-01 00:45:00']
+
+def legacy_request(values=SAMPLES):
+    for v in values:
+        PST.localize(parser.isoparse(v)).isoformat()
+
+def fast_request(values=SAMPLES):
+    for v in values:
+        timeutil.format_local(timeutil.localize(timeutil.parse_local(v)).replace(tzinfo=None))
+
+def legacy_parse(values=SAMPLES):
+    for v in values:
+        PST.localize(parser.isoparse(v))
+
+def fast_parse(values=SAMPLES):
+    for v in values:
+        timeutil.localize(timeutil.parse_local(v))
+
+def legacy_now():
+    from datetime import datetime
+    datetime.now(PST)
+
+def main(argv=None):
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument('--number', type=int, default=20000)
+    ap.add_argument('--repeat', type=int, default=5)
+    opts = ap.parse_args(argv)
+
+    cases = [
+        ('parse+localize (legacy)', legacy_parse),
+        ('parse+localize (timeutil)', fast_parse),
+        ('parse+localize+format (legacy)', legacy_request),
+        ('parse+localize+format (timeutil)', fast_request),
+        ('now (pytz)', legacy_now),
+        ('now (timeutil)', timeutil.now_pst),
+    ]
+    per_call = len(SAMPLES)
+    for name, fn in cases:
+        best = min(timeit.repeat(fn, number=opts.number, repeat=opts.repeat))
+        calls = opts.number * (1 if fn in (legacy_now, timeutil.now_pst) else per_call)
+        print(f'{name:<36} {best / calls * 1e6:8.3f} us/timestamp')
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,327 @@
+"""Concurrency stress harness for double-booking detection.
+
+Starts the reservation app against a scratch SQLite database, fires thousands of
+overlapping POST /reservations requests from many client threads spread over
+several client processes, then checks directly in the database that no two
+reservations overlap.
+
+Every combination of worker model (how the server handles concurrent requests)
+and storage profile (how the SQLite file is configured) gets its own run and
+its own row in the report, so throughput changes can be compared against
+correctness.
+
+Usage:
+    python tools/stress_booking.py
+    python tools/stress_booking.py --requests 5000 --client-procs 4 --client-threads 16
+    python tools/stress_booking.py --worker-models threaded --storage-profiles wal --json
+"""
+import argparse
+import http.client
+import json
+import multiprocessing
+import os
+import random
+import shutil
+import socket
+import sqlite3
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+from collections import Counter
+from datetime import datetime, timedelta
+
+import pytz
+
+REPO_ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+PST = pytz.timezone('America/Los_Angeles')
+
+# Server-side concurrency models. 'gunicorn-*' models are skipped when gunicorn
+# is not installed.
+WORKER_MODELS = ('threaded', 'processes', 'gunicorn-sync', 'gunicorn-gthread')
+
+# SQLite journal configurations applied to the scratch database before the
+# server starts.
+STORAGE_PROFILES = {
+    'rollback': {'journal_mode': 'DELETE', 'synchronous': 'FULL'},
+    'wal': {'journal_mode': 'WAL', 'synchronous': 'NORMAL'},
+}
+
+# Overlap invariant: any row returned is a double booking.
+OVERLAP_SQL = """
+    SELECT a.id, b.id, a.start_time, a.end_time, b.start_time, b.end_time
+    FROM reservation a
+    JOIN reservation b ON a.id < b.id AND a.resource_id = b.resource_id
+    WHERE a.start_time < b.end_time AND b.start_time < a.end_time
+"""
+
+
+def _free_port():
+    with socket.socket(socket.AF_INET, socket.SOCK_STREAM) as s:
+        s.bind(('127.0.0.1', 0))
+        return s.getsockname()[1]
+
+
+def _wait_for_port(port, proc, timeout=30.0):
+    deadline = time.monotonic() + timeout
+    while time.monotonic() < deadline:
+        if proc.poll() is not None:
+            raise RuntimeError(f"server exited early with code {proc.returncode}")
+        try:
+            with socket.create_connection(('127.0.0.1', port), timeout=0.5):
+                return
+        except OSError:
+            time.sleep(0.1)
+    raise RuntimeError(f"server did not start listening on port {port}")
+
+
+def prepare_database(db_path, profile, resources):
+    """Creates the schema and resources and applies the storage profile to a fresh database file."""
+    env = dict(os.environ, RESERVATION_DATABASE_URI=f'sqlite:///{db_path}')
+    # create_app() bootstraps the schema.
+    subprocess.run([sys.executable, '-c', 'from app import create_app; create_app()'],
+                   cwd=REPO_ROOT, env=env, check=True)
+    pragmas = STORAGE_PROFILES[profile]
+    conn = sqlite3.connect(db_path)
+    try:
+        # create_app() already added the default resource (id 1).
+        conn.executemany('INSERT INTO resource (name) VALUES (?)',
+                         [(f'stress-{i}',) for i in range(2, resources + 1)])
+        conn.commit()
+        # journal_mode=WAL is persistent in the file; synchronous is per
+        # connection and only documents the intent here.
+        conn.execute(f"PRAGMA journal_mode={pragmas['journal_mode']}")
+        conn.execute(f"PRAGMA synchronous={pragmas['synchronous']}")
+    finally:
+        conn.close()
+
+
+def start_server(model, port, db_path, server_workers):
+    env = dict(os.environ, RESERVATION_DATABASE_URI=f'sqlite:///{db_path}')
+    if model.startswith('gunicorn-'):
+        worker_class = model.split('-', 1)[1]
+        cmd = ['gunicorn', '--bind', f'127.0.0.1:{port}', '--workers', str(server_workers),
+               '--worker-class', worker_class, '--log-level', 'warning']
+        if worker_class == 'gthread':
+            cmd += ['--threads', '8']
+        cmd.append('app:app')
+    else:
+        cmd = [sys.executable, os.path.abspath(__file__), '--serve', model,
+               '--port', str(port), '--server-workers', str(server_workers)]
+    proc = subprocess.Popen(cmd, cwd=REPO_ROOT, env=env,
+                            stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+    _wait_for_port(port, proc)
+    return proc
+
+
+def serve(model, port, server_workers):
+    """Entry point for the werkzeug-based worker models (runs in the server subprocess)."""
+    sys.path.insert(0, REPO_ROOT)
+    from werkzeug.serving import run_simple
+    from app import create_app
+
+    app = create_app()
+
+    if model == 'threaded':
+        run_simple('127.0.0.1', port, app, threaded=True)
+    elif model == 'processes':
+        run_simple('127.0.0.1', port, app, threaded=False, processes=server_workers)
+    else:
+        raise SystemExit(f"unknown werkzeug worker model: {model}")
+
+
+def build_workload(total, seed, resources):
+    """Builds overlapping booking requests packed into one busy day.
+
+    Start times fall on the 15-minute grid of a single window tomorrow, so most
+    requests overlap several others on the same resource and the server has to
+    reject them.
+    """
+    rng = random.Random(seed)
+    day = (datetime.now(PST) + timedelta(days=1)).replace(hour=0, minute=0, second=0, microsecond=0, tzinfo=None)
+    payloads = []
+    for i in range(total):
+        start = day + timedelta(hours=8, minutes=15 * rng.randrange(0, 8 * 4))
+        end = start + timedelta(minutes=15 * rng.randint(1, 8))
+        payloads.append({
+            'resource_id': rng.randint(1, resources),
+            'username': f'stress{i % 97}',
+            'start_time': start.strftime('%Y-%m-%d %H:%M'),
+            'end_time': end.strftime('%Y-%m-%d %H:%M'),
+        })
+    return payloads
+
+
+def _post(port, payload, timeout):
+    body = json.dumps(payload)
+    conn = http.client.HTTPConnection('127.0.0.1', port, timeout=timeout)
+    try:
+        conn.request('POST', '/reservations', body=body, headers={'Content-Type': 'application/json'})
+        resp = conn.getresponse()
+        resp.read()
+        return resp.status
+    finally:
+        conn.close()
+
+
+def client_process(args):
+    """Issues one slice of the workload from `threads` threads; returns (status counts, latencies)."""
+    port, payloads, threads, timeout = args
+    statuses = Counter()
+    latencies = []
+    lock = threading.Lock()
+    cursor = iter(payloads)
+
+    def worker():
+        while True:
+            with lock:
+                payload = next(cursor, None)
+            if payload is None:
+                return
+            t0 = time.perf_counter()
+            try:
+                status = _post(port, payload, timeout)
+            except (OSError, http.client.HTTPException):
+                status = 'error'
+            elapsed = time.perf_counter() - t0
+            with lock:
+                statuses[status] += 1
+                latencies.append(elapsed)
+
+    pool = [threading.Thread(target=worker) for _ in range(threads)]
+    for t in pool:
+        t.start()
+    for t in pool:
+        t.join()
+    return statuses, latencies
+
+
+def find_overlaps(db_path):
+    conn = sqlite3.connect(db_path)
+    try:
+        overlaps = conn.execute(OVERLAP_SQL).fetchall()
+        rows = conn.execute('SELECT COUNT(*) FROM reservation').fetchone()[0]
+    finally:
+        conn.close()
+    return rows, overlaps
+
+
+def _percentile(sorted_values, pct):
+    if not sorted_values:
+        return 0.0
+    idx = min(len(sorted_values) - 1, int(round(pct / 100.0 * (len(sorted_values) - 1))))
+    return sorted_values[idx]
+
+
+def run_one(model, profile, opts):
+    workdir = tempfile.mkdtemp(prefix='stress_booking_')
+    db_path = os.path.join(workdir, 'stress.db')
+    proc = None
+    try:
+        prepare_database(db_path, profile, opts.resources)
+        port = _free_port()
+        proc = start_server(model, port, db_path, opts.server_workers)
+
+        payloads = build_workload(opts.requests, opts.seed, opts.resources)
+        slices = [(port, payloads[i::opts.client_procs], opts.client_threads, opts.timeout)
+                  for i in range(opts.client_procs)]
+
+        t0 = time.perf_counter()
+        with multiprocessing.Pool(opts.client_procs) as pool:
+            results = pool.map(client_process, slices)
+        elapsed = time.perf_counter() - t0
+    finally:
+        if proc is not None:
+            proc.terminate()
+            try:
+                proc.wait(timeout=10)
+            except subprocess.TimeoutExpired:
+                proc.kill()
+
+    try:
+        rows, overlaps = find_overlaps(db_path)
+    finally:
+        shutil.rmtree(workdir, ignore_errors=True)
+
+    statuses = Counter()
+    latencies = []
+    for s, l in results:
+        statuses.update(s)
+        latencies.extend(l)
+    latencies.sort()
+
+    # 503 is the app's answer when SQLite's lock wait (SQLITE_BUSY_TIMEOUT_SECONDS)
+    # runs out; it is counted apart from other server errors.
+    busy = statuses.get(503, 0)
+    server_errors = sum(n for code, n in statuses.items() if isinstance(code, int) and code >= 500) - busy
+    return {
+        'worker_model': model,
+        'storage_profile': profile,
+        'requests': opts.requests,
+        'created_201': statuses.get(201, 0),
+        'conflict_409': statuses.get(409, 0),
+        'busy_503': busy,
+        'server_error_5xx': server_errors,
+        'other': sum(statuses.values()) - statuses.get(201, 0) - statuses.get(409, 0) - busy - server_errors,
+        'elapsed_s': round(elapsed, 3),
+        'throughput_rps': round(opts.requests / elapsed, 1) if elapsed else 0.0,
+        'p50_ms': round(_percentile(latencies, 50) * 1000, 2),
+        'p99_ms': round(_percentile(latencies, 99) * 1000, 2),
+        'rows': rows,
+        'overlaps': len(overlaps),
+        'overlap_sample': overlaps[:5],
+    }
+
+
+def print_report(results):
+    header = ('model', 'storage', '201', '409', '503', '5xx', 'other', 'req/s', 'p50ms', 'p99ms', 'rows', 'overlaps')
+    print(' '.join(f'{h:>16}' if i < 2 else f'{h:>8}' for i, h in enumerate(header)))
+    for r in results:
+        cols = (r['worker_model'], r['storage_profile'], r['created_201'], r['conflict_409'],
+                r['busy_503'], r['server_error_5xx'], r['other'], r['throughput_rps'], r['p50_ms'], r['p99_ms'],
+                r['rows'], r['overlaps'])
+        print(' '.join(f'{c:>16}' if i < 2 else f'{c:>8}' for i, c in enumerate(cols)))
+    for r in results:
+        for sample in r['overlap_sample']:
+            print(f"DOUBLE BOOKING [{r['worker_model']}/{r['storage_profile']}]: {sample}")
+
+
+def main(argv=None):
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument('--requests', type=int, default=2000, help='total POSTs per run')
+    ap.add_argument('--client-procs', type=int, default=4, help='client processes')
+    ap.add_argument('--client-threads', type=int, default=8, help='threads per client process')
+    ap.add_argument('--resources', type=int, default=1, help='resources the load is spread over')
+    ap.add_argument('--server-workers', type=int, default=4, help='server processes for multi-process models')
+    ap.add_argument('--worker-models', default=','.join(WORKER_MODELS))
+    ap.add_argument('--storage-profiles', default=','.join(STORAGE_PROFILES))
+    ap.add_argument('--seed', type=int, default=1)
+    ap.add_argument('--timeout', type=float, default=30.0, help='per-request timeout in seconds')
+    ap.add_argument('--json', action='store_true', help='print results as JSON')
+    # Internal: run a werkzeug server for the given worker model.
+    ap.add_argument('--serve', help=argparse.SUPPRESS)
+    ap.add_argument('--port', type=int, help=argparse.SUPPRESS)
+    opts = ap.parse_args(argv)
+
+    if opts.serve:
+        serve(opts.serve, opts.port, opts.server_workers)
+        return 0
+
+    results = []
+    for model in opts.worker_models.split(','):
+        if model.startswith('gunicorn-') and shutil.which('gunicorn') is None:
+            print(f"skipping {model}: gunicorn is not installed", file=sys.stderr)
+            continue
+        for profile in opts.storage_profiles.split(','):
+            results.append(run_one(model, profile, opts))
+
+    if opts.json:
+        print(json.dumps(results, indent=2))
+    else:
+        print_report(results)
+    return 1 if any(r['overlaps'] for r in results) else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,45 @@
+"""Downloads the pinned front-end libraries in assets.VENDOR into static/.
+
+Files that are already present are left alone, so this only needs network
+access once. Commit the results; the app serves them under content-hashed
+URLs (see assets.py).
+
+Usage:
+    python tools/vendor_assets.py [--force]
+"""
+import argparse
+import os
+import sys
+import urllib.request
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+sys.path.insert(0, ROOT)
+
+from assets import VENDOR  # noqa: E402
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('--force', action='store_true', help='download files that already exist again')
+    args = parser.parse_args()
+
+    failed = 0
+    for path, url in sorted(VENDOR.items()):
+        target = os.path.join(ROOT, 'static', *path.split('/'))
+        if os.path.exists(target) and not args.force:
+            print(f'ok       {path}')
+            continue
+        os.makedirs(os.path.dirname(target), exist_ok=True)
+        try:
+            with urllib.request.urlopen(url, timeout=30) as response:
+                data = response.read()
+        except OSError as e:
+            print(f'FAILED   {path}: {e}')
+            failed += 1
+            continue
+        with open(target, 'wb') as f:
+            f.write(data)
+        print(f'fetched  {path} ({len(data)} bytes)')
+    return 1 if failed else 0
+
+if __name__ == '__main__':
+    sys.exit(main())